@@ -1,12 +1,11 @@
 extern crate cbindgen;
 
 use cbindgen::RenameRule::CamelCase;
-use cbindgen::{ParseConfig, SortKey::Name, StructConfig};
+use cbindgen::{SortKey::Name, StructConfig};
 
 use cbindgen::Config;
 use std::env;
 use std::path::PathBuf;
-use std::vec;
 
 fn main() {
     let crate_dir = env::var("CARGO_MANIFEST_DIR").unwrap();
@@ -22,11 +21,6 @@ fn main() {
         ..Default::default()
     };
 
-    let parse = ParseConfig {
-        parse_deps: true,
-        include: Some(vec![String::from("reqwest::blocking")]),
-        ..Default::default()
-    };
     let mut config = Config::default();
     config.namespace = Some(String::from("crab::http"));
     // config.includes = vec![String::from("ffi.hpp")];
@@ -34,7 +28,8 @@ fn main() {
     config.cpp_compat = true;
     config.sort_by = Name;
     config.structure = structure;
-    config.parse = parse;
+    // Dependencies are not parsed: reqwest types only cross the boundary as
+    // opaque handles.
 
     let _ = match cbindgen::generate_with_config(&crate_dir, config) {
         Ok(x) => x.write_to_file(&output_file),
@@ -0,0 +1,287 @@
+//! Size-classed pool for response body buffers.
+//!
+//! Buffers come back when the `RespBody` holding them is freed. They are
+//! cached on the freeing thread first and in a shared depot second, so a
+//! steady stream of similar responses stops reaching the allocator.
+
+use anyhow::anyhow;
+use bytes::Bytes;
+use ffi::update_last_error;
+use http_err::HttpErrorKind;
+use std::cell::RefCell;
+use std::mem;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+/// Smallest class is 1 KiB; every class is twice the one before.
+const MIN_CLASS_SHIFT: u32 = 10;
+
+/// 1 KiB up to 16 MiB.
+const CLASSES: usize = 15;
+
+/// Size of the largest class; also the most a body buffer reserves up front
+/// on the word of a `Content-Length`.
+pub const MAX_CLASS_SIZE: usize = 1 << (MIN_CLASS_SHIFT as usize + CLASSES - 1);
+
+/// Limits of the body buffer pool. All zeroes disables it.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct BodyPoolLimits {
+    /// Largest buffer kept, rounded up to a power of two between 1 KiB and
+    /// 16 MiB. Bodies above it are allocated and freed as before.
+    pub max_buffer: usize,
+    /// Bytes each thread may keep for itself.
+    pub thread_cache_bytes: usize,
+    /// Bytes kept in the depot shared by all threads.
+    pub shared_bytes: usize,
+}
+
+/// Counters since the process started.
+#[repr(C)]
+#[derive(Default)]
+pub struct BodyPoolStats {
+    /// Buffers served from the calling thread's cache.
+    pub thread_hits: u64,
+    /// Buffers served from the shared depot.
+    pub shared_hits: u64,
+    /// Poolable requests that had to allocate.
+    pub misses: u64,
+    /// Buffers freed because every cache was full.
+    pub discarded: u64,
+    /// Bytes currently held in the shared depot.
+    pub shared_bytes: u64,
+}
+
+static MAX_CLASS: AtomicUsize = AtomicUsize::new(7); // 64 KiB
+static THREAD_CACHE_BYTES: AtomicUsize = AtomicUsize::new(1024 * 1024);
+static SHARED_BYTES: AtomicUsize = AtomicUsize::new(16 * 1024 * 1024);
+
+static THREAD_HITS: AtomicU64 = AtomicU64::new(0);
+static SHARED_HITS: AtomicU64 = AtomicU64::new(0);
+static MISSES: AtomicU64 = AtomicU64::new(0);
+static DISCARDED: AtomicU64 = AtomicU64::new(0);
+
+struct FreeLists {
+    lists: [Vec<Vec<u8>>; CLASSES],
+    bytes: usize,
+}
+
+const EMPTY_LIST: Vec<Vec<u8>> = Vec::new();
+
+impl FreeLists {
+    const fn new() -> Self {
+        FreeLists {
+            lists: [EMPTY_LIST; CLASSES],
+            bytes: 0,
+        }
+    }
+
+    fn pop(&mut self, class: usize) -> Option<Vec<u8>> {
+        let buf = self.lists[class].pop()?;
+        self.bytes -= buf.capacity();
+        Some(buf)
+    }
+
+    /// Keep `buf` if that stays within `limit` bytes.
+    fn push(&mut self, class: usize, buf: Vec<u8>, limit: usize) -> Result<(), Vec<u8>> {
+        if self.bytes + buf.capacity() > limit {
+            return Err(buf);
+        }
+        self.bytes += buf.capacity();
+        self.lists[class].push(buf);
+        Ok(())
+    }
+}
+
+struct ThreadCache(FreeLists);
+
+impl Drop for ThreadCache {
+    fn drop(&mut self) {
+        // Hand the buffers of an exiting thread to the ones that remain.
+        for (class, list) in self.0.lists.iter_mut().enumerate() {
+            for buf in list.drain(..) {
+                release_shared(class, buf);
+            }
+        }
+    }
+}
+
+thread_local! {
+    static CACHE: RefCell<ThreadCache> = const { RefCell::new(ThreadCache(FreeLists::new())) };
+}
+
+static DEPOT: Mutex<FreeLists> = Mutex::new(FreeLists::new());
+
+fn release_shared(class: usize, buf: Vec<u8>) {
+    let limit = SHARED_BYTES.load(Ordering::Relaxed);
+    let mut depot = DEPOT.lock().unwrap_or_else(|e| e.into_inner());
+    if depot.push(class, buf, limit).is_err() {
+        DISCARDED.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+/// Class serving `len` bytes, if it is poolable.
+fn class_for(len: usize) -> Option<usize> {
+    let size = len.max(1).checked_next_power_of_two()?;
+    let class = (size.trailing_zeros().max(MIN_CLASS_SHIFT) - MIN_CLASS_SHIFT) as usize;
+    if class < MAX_CLASS.load(Ordering::Relaxed).min(CLASSES) {
+        Some(class)
+    } else {
+        None
+    }
+}
+
+/// An empty buffer with room for at least `len` bytes.
+pub fn take(len: usize) -> Vec<u8> {
+    let class = match class_for(len) {
+        Some(v) => v,
+        None => return Vec::with_capacity(len),
+    };
+
+    let cached = CACHE
+        .try_with(|cache| cache.borrow_mut().0.pop(class))
+        .ok()
+        .and_then(|v| v);
+    if let Some(buf) = cached {
+        THREAD_HITS.fetch_add(1, Ordering::Relaxed);
+        return buf;
+    }
+
+    let shared = DEPOT.lock().unwrap_or_else(|e| e.into_inner()).pop(class);
+    if let Some(buf) = shared {
+        SHARED_HITS.fetch_add(1, Ordering::Relaxed);
+        return buf;
+    }
+
+    MISSES.fetch_add(1, Ordering::Relaxed);
+    Vec::with_capacity(1 << (class as u32 + MIN_CLASS_SHIFT))
+}
+
+/// Return a buffer from `take`. Buffers that grew to a size outside the
+/// classes are simply freed.
+pub fn give(mut buf: Vec<u8>) {
+    let cap = buf.capacity();
+    let class = match class_for(cap) {
+        Some(v) if cap == 1 << (v as u32 + MIN_CLASS_SHIFT) => v,
+        _ => return,
+    };
+
+    buf.clear();
+    let limit = THREAD_CACHE_BYTES.load(Ordering::Relaxed);
+    let rest = CACHE
+        .try_with(|cache| cache.borrow_mut().0.push(class, mem::take(&mut buf), limit))
+        .unwrap_or(Err(buf));
+    if let Err(buf) = rest {
+        release_shared(class, buf);
+    }
+}
+
+/// Owner that sends its buffer back to the pool once the last `Bytes`
+/// viewing it is gone.
+struct Pooled(Vec<u8>);
+
+impl AsRef<[u8]> for Pooled {
+    fn as_ref(&self) -> &[u8] {
+        &self.0
+    }
+}
+
+impl Drop for Pooled {
+    fn drop(&mut self) {
+        give(mem::take(&mut self.0));
+    }
+}
+
+/// Freeze a buffer from `take` into `Bytes` that return it on drop.
+pub fn into_bytes(buf: Vec<u8>) -> Bytes {
+    if buf.is_empty() {
+        give(buf);
+        return Bytes::new();
+    }
+    Bytes::from_owner(Pooled(buf))
+}
+
+/// Apply new limits to the process-wide pool.
+pub fn configure(limits: &BodyPoolLimits) {
+    let class = match limits.max_buffer {
+        0 => 0,
+        v => v
+            .checked_next_power_of_two()
+            .map_or(CLASSES, |size| {
+                (size.trailing_zeros().max(MIN_CLASS_SHIFT) - MIN_CLASS_SHIFT) as usize + 1
+            })
+            .min(CLASSES),
+    };
+    MAX_CLASS.store(class, Ordering::Relaxed);
+    THREAD_CACHE_BYTES.store(limits.thread_cache_bytes, Ordering::Relaxed);
+    SHARED_BYTES.store(limits.shared_bytes, Ordering::Relaxed);
+
+    // Free what the new limits no longer allow. Thread caches keep theirs
+    // until they are taken.
+    let mut depot = DEPOT.lock().unwrap_or_else(|e| e.into_inner());
+    let old = mem::replace(&mut *depot, FreeLists::new());
+    for (c, list) in IntoIterator::into_iter(old.lists).enumerate().take(class) {
+        for buf in list {
+            let _ = depot.push(c, buf, limits.shared_bytes);
+        }
+    }
+}
+
+/// Fill `stats` with the pool counters.
+#[no_mangle]
+pub unsafe extern "C" fn body_pool_stats(stats: *mut BodyPoolStats) -> bool {
+    if stats.is_null() {
+        update_last_error(
+            HttpErrorKind::InvalidInput,
+            anyhow!("stats is null when use body_pool_stats"),
+        );
+        return false;
+    }
+
+    let shared_bytes = DEPOT.lock().unwrap_or_else(|e| e.into_inner()).bytes;
+    *stats = BodyPoolStats {
+        thread_hits: THREAD_HITS.load(Ordering::Relaxed),
+        shared_hits: SHARED_HITS.load(Ordering::Relaxed),
+        misses: MISSES.load(Ordering::Relaxed),
+        discarded: DISCARDED.load(Ordering::Relaxed),
+        shared_bytes: shared_bytes as u64,
+    };
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Bytes held by this thread's cache; unlike the counters, other tests
+    /// running in parallel can't move it.
+    fn cached() -> usize {
+        CACHE.with(|cache| cache.borrow().0.bytes)
+    }
+
+    #[test]
+    fn buffers_come_back_by_class() {
+        let mut buf = take(3000);
+        assert_eq!(buf.capacity(), 4096);
+        buf.extend_from_slice(&[7; 3000]);
+        let ptr = buf.as_ptr();
+        let before = cached();
+        drop(into_bytes(buf));
+        assert_eq!(cached(), before + 4096);
+
+        let again = take(2049);
+        assert_eq!(again.as_ptr(), ptr);
+        assert!(again.is_empty());
+        assert_eq!(cached(), before);
+        give(again);
+
+        // Too big to pool, or grown off its class: freed, not kept.
+        let before = cached();
+        give(take(1 << 20));
+        let mut odd = take(1024);
+        odd.reserve_exact(1500);
+        assert_ne!(odd.capacity(), 1024);
+        give(odd);
+        assert_eq!(cached(), before);
+    }
+}
@@ -0,0 +1,134 @@
+//! Results written into memory the caller allocates, so they can live in
+//! the caller's arenas and be released in bulk instead of one FFI free at a
+//! time.
+
+use ffi::Pair;
+use libc::{c_char, c_void};
+use reqwest::header::HeaderMap;
+use std::mem;
+use std::ptr;
+
+/// Allocation hook supplied by the caller.
+///
+/// `alloc` returns `size` bytes aligned to `align`, or null. The memory is
+/// the caller's: this library never frees it, so an arena may reclaim it
+/// all at once.
+#[repr(C)]
+pub struct Allocator {
+    pub alloc: extern "C" fn(user_data: *mut c_void, size: usize, align: usize) -> *mut u8,
+    pub user_data: *mut c_void,
+}
+
+impl Allocator {
+    pub fn allocate(&self, size: usize, align: usize) -> Option<*mut u8> {
+        let p = (self.alloc)(self.user_data, size, align);
+        if p.is_null() {
+            None
+        } else {
+            Some(p)
+        }
+    }
+
+    /// `data` followed by a NUL, which isn't counted in the length.
+    pub fn copy_str(&self, data: &[u8]) -> Option<*mut u8> {
+        let p = self.allocate(data.len() + 1, 1)?;
+        unsafe {
+            ptr::copy_nonoverlapping(data.as_ptr(), p, data.len());
+            *p.add(data.len()) = 0;
+        }
+        Some(p)
+    }
+
+    /// Every header as a NUL-terminated `Pair`, in one allocation holding
+    /// the array followed by the strings it points to.
+    pub fn copy_headers(&self, headers: &HeaderMap) -> Option<(*mut Pair, usize)> {
+        let count = headers.len();
+        let strings: usize = headers
+            .iter()
+            .map(|(k, v)| k.as_str().len() + v.as_bytes().len() + 2)
+            .sum();
+        let table = count * mem::size_of::<Pair>();
+        let base = self.allocate((table + strings).max(1), mem::align_of::<Pair>())?;
+
+        unsafe {
+            let pairs = base as *mut Pair;
+            let mut text = base.add(table);
+            for (i, (k, v)) in headers.iter().enumerate() {
+                let key = text;
+                text = put_str(text, k.as_str().as_bytes());
+                let value = text;
+                text = put_str(text, v.as_bytes());
+                pairs.add(i).write(Pair {
+                    key: key as *const c_char,
+                    value: value as *const c_char,
+                });
+            }
+            Some((pairs, count))
+        }
+    }
+}
+
+/// Write `data` and a NUL at `dst`, returning the byte after them.
+unsafe fn put_str(dst: *mut u8, data: &[u8]) -> *mut u8 {
+    ptr::copy_nonoverlapping(data.as_ptr(), dst, data.len());
+    *dst.add(data.len()) = 0;
+    dst.add(data.len() + 1)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CStr;
+
+    /// Bump allocator over a fixed buffer, as an arena would be.
+    struct Arena {
+        buf: Vec<u8>,
+        used: usize,
+    }
+
+    extern "C" fn arena_alloc(user_data: *mut c_void, size: usize, align: usize) -> *mut u8 {
+        let arena = unsafe { &mut *(user_data as *mut Arena) };
+        let base = arena.buf.as_mut_ptr() as usize;
+        let start = (base + arena.used + align - 1) / align * align - base;
+        if start + size > arena.buf.len() {
+            return ptr::null_mut();
+        }
+        arena.used = start + size;
+        unsafe { arena.buf.as_mut_ptr().add(start) }
+    }
+
+    #[test]
+    fn headers_land_in_one_block() {
+        let mut arena = Arena {
+            buf: vec![0; 256],
+            used: 0,
+        };
+        let allocator = Allocator {
+            alloc: arena_alloc,
+            user_data: &mut arena as *mut Arena as *mut c_void,
+        };
+
+        let mut headers = HeaderMap::new();
+        headers.insert("content-type", "text/plain".parse().unwrap());
+        headers.append("x-multi", "a".parse().unwrap());
+        headers.append("x-multi", "b".parse().unwrap());
+
+        let (pairs, count) = allocator.copy_headers(&headers).unwrap();
+        assert_eq!(count, 3);
+        let got: Vec<(String, String)> = (0..count)
+            .map(|i| unsafe {
+                let pair = &*pairs.add(i);
+                (
+                    CStr::from_ptr(pair.key).to_str().unwrap().to_string(),
+                    CStr::from_ptr(pair.value).to_str().unwrap().to_string(),
+                )
+            })
+            .collect();
+        assert_eq!(got[0], ("content-type".into(), "text/plain".into()));
+        assert_eq!(got[2], ("x-multi".into(), "b".into()));
+
+        let table = 3 * mem::size_of::<Pair>();
+        assert_eq!(arena.used, table + 13 + 11 + 8 + 2 + 8 + 2);
+        assert!(allocator.copy_str(&[1; 300]).is_none());
+    }
+}
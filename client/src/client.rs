@@ -1,14 +1,60 @@
 use crate::ffi::*;
 use anyhow::{anyhow, Error};
-use ::{function, response};
+use body_pool::{self, BodyPoolLimits};
+use futures_util::{FutureExt, StreamExt};
 use http_err::HttpErrorKind;
 use libc::c_char;
-use reqwest::blocking::{Client, ClientBuilder, Request, RequestBuilder};
 use reqwest::header::HeaderMap;
-use reqwest::{redirect, Method, Url};
+use reqwest::{redirect, Client, Method, Request, RequestBuilder, Url};
+use runtime;
 use std::net::{IpAddr, SocketAddr};
+use std::time::Duration;
 use std::{ptr, slice};
-use utils::extract_file_name;
+use utils::{self, extract_file_name};
+use {function, response};
+
+/// `reqwest::ClientBuilder` plus the options whose blocking semantics the
+/// async builder can't express directly.
+///
+/// The blocking builder defaulted to a 30 second total timeout and accepted
+/// `None` to disable it; the async one has no default and can't be unset, so
+/// the timeout is kept here and only applied in `build`.
+pub struct ClientBuilder {
+    inner: reqwest::ClientBuilder,
+    timeout: Option<Duration>,
+    body_pool: Option<BodyPoolLimits>,
+}
+
+impl ClientBuilder {
+    pub fn new() -> Self {
+        Self {
+            inner: reqwest::ClientBuilder::new(),
+            timeout: Some(Duration::from_secs(30)),
+            body_pool: None,
+        }
+    }
+
+    fn with_inner<F>(self, func: F) -> Self
+    where
+        F: FnOnce(reqwest::ClientBuilder) -> reqwest::ClientBuilder,
+    {
+        Self {
+            inner: func(self.inner),
+            ..self
+        }
+    }
+
+    fn build(self) -> reqwest::Result<Client> {
+        if let Some(ref limits) = self.body_pool {
+            body_pool::configure(limits);
+        }
+
+        match self.timeout {
+            Some(v) => self.inner.timeout(v).build(),
+            None => self.inner.build(),
+        }
+    }
+}
 
 /// Constructs a new `ClientBuilder`.
 #[no_mangle]
@@ -30,10 +76,8 @@ pub unsafe extern "C" fn client_builder_default_headers(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
     let header_map = Box::from_raw(header_map);
-    let result = r_client_builder.default_headers(*header_map);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.default_headers(*header_map)))
 }
 
 /// Sets the `User-Agent` header to be used by this client.
@@ -57,11 +101,7 @@ pub unsafe extern "C" fn client_builder_user_agent(
         Some(v) => v,
     };
 
-    let r_client_builder: Box<ClientBuilder> = Box::from_raw(handle);
-    let result: ClientBuilder = r_client_builder.user_agent(r_value);
-    let res = Box::into_raw(Box::new(result));
-
-    res
+    update_in_place(handle, |c| c.with_inner(|b| b.user_agent(r_value)))
 }
 
 /// Set a `redirect::Policy` for this client.
@@ -80,10 +120,8 @@ pub unsafe extern "C" fn client_builder_redirect(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
     let r_policy: redirect::Policy = redirect::Policy::limited(policy);
-    let result = r_client_builder.redirect(r_policy);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.redirect(r_policy)))
 }
 
 /// Enable or disable automatic setting of the `Referer` header.
@@ -102,9 +140,7 @@ pub unsafe extern "C" fn client_builder_referer(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.referer(enable);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.referer(enable)))
 }
 
 // Proxy options
@@ -127,9 +163,7 @@ pub unsafe extern "C" fn client_builder_proxy(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.proxy(*Box::from_raw(proxy));
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.proxy(*Box::from_raw(proxy))))
 }
 
 // Timeout options
@@ -152,9 +186,33 @@ pub unsafe extern "C" fn client_builder_timeout(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.timeout(u64_to_millis_duration(millisecond));
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| ClientBuilder {
+        timeout: u64_to_millis_duration(millisecond),
+        ..c
+    })
+}
+
+/// Set the limits of the pool response bodies are read into.
+///
+/// The pool is shared by every client in the process, so the limits of the
+/// client built last apply. All zeroes turns pooling off.
+#[no_mangle]
+pub unsafe extern "C" fn client_builder_body_pool(
+    handle: *mut ClientBuilder,
+    limits: *const BodyPoolLimits,
+) -> *mut ClientBuilder {
+    if handle.is_null() || limits.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client_builder handle or limits is null when use body_pool"),
+        );
+        return ptr::null_mut();
+    }
+
+    update_in_place(handle, |c| ClientBuilder {
+        body_pool: Some(*limits),
+        ..c
+    })
 }
 
 // Connect Timeout options
@@ -177,9 +235,10 @@ pub unsafe extern "C" fn client_builder_connect_timeout(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.connect_timeout(u64_to_millis_duration(millisecond));
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| match u64_to_millis_duration(millisecond) {
+        Some(v) => c.with_inner(|b| b.connect_timeout(v)),
+        None => c,
+    })
 }
 
 // HTTP options
@@ -202,10 +261,9 @@ pub unsafe extern "C" fn client_builder_pool_idle_timeout(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.pool_idle_timeout(u64_to_millis_duration(millisecond));
-
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.pool_idle_timeout(u64_to_millis_duration(millisecond)))
+    })
 }
 
 /// Sets the maximum idle connection per host allowed in the pool.
@@ -222,9 +280,7 @@ pub unsafe extern "C" fn client_builder_pool_max_idle_per_host(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.pool_max_idle_per_host(max);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.pool_max_idle_per_host(max)))
 }
 
 /// Sets the maximum idle connection per host allowed in the pool.
@@ -240,9 +296,7 @@ pub unsafe extern "C" fn client_builder_http1_title_case_headers(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http1_title_case_headers();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.http1_title_case_headers()))
 }
 
 /// Set whether HTTP/1 connections will accept obsolete line folding for
@@ -262,9 +316,9 @@ pub unsafe extern "C" fn client_builder_http1_allow_obsolete_multiline_headers_i
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http1_allow_obsolete_multiline_headers_in_responses(val);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.http1_allow_obsolete_multiline_headers_in_responses(val))
+    })
 }
 
 /// Only use HTTP/1.
@@ -280,9 +334,7 @@ pub unsafe extern "C" fn client_builder_http1_only(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http1_only();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.http1_only()))
 }
 
 /// Allow HTTP/0.9 responses
@@ -298,9 +350,7 @@ pub unsafe extern "C" fn client_builder_http09_responses(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http09_responses();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.http09_responses()))
 }
 
 /// Only use HTTP/2.
@@ -316,9 +366,7 @@ pub unsafe extern "C" fn client_builder_http2_prior_knowledge(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http2_prior_knowledge();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.http2_prior_knowledge()))
 }
 
 /// Sets the `SETTINGS_INITIAL_WINDOW_SIZE` option for HTTP2 stream-level flow control.
@@ -337,9 +385,9 @@ pub unsafe extern "C" fn client_builder_http2_initial_stream_window_size(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http2_initial_stream_window_size(*size);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.http2_initial_stream_window_size(*size))
+    })
 }
 
 /// Sets the max connection-level flow control for HTTP2
@@ -358,9 +406,9 @@ pub unsafe extern "C" fn client_builder_http2_initial_connection_window_size(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http2_initial_connection_window_size(*size);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.http2_initial_connection_window_size(*size))
+    })
 }
 
 /// Sets whether to use an adaptive flow control.
@@ -380,9 +428,9 @@ pub unsafe extern "C" fn client_builder_http2_adaptive_window(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http2_adaptive_window(enable);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.http2_adaptive_window(enable))
+    })
 }
 
 /// Sets the maximum frame size to use for HTTP2.
@@ -401,9 +449,7 @@ pub unsafe extern "C" fn client_builder_http2_max_frame_size(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.http2_max_frame_size(*size);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.http2_max_frame_size(*size)))
 }
 
 // TCP options
@@ -424,9 +470,7 @@ pub unsafe extern "C" fn client_builder_tcp_nodelay(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.tcp_nodelay(enable);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.tcp_nodelay(enable)))
 }
 
 /// Bind to a local IP Address.
@@ -460,9 +504,9 @@ pub unsafe extern "C" fn client_builder_local_address(
         }
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.local_address(r_local_address);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.local_address(r_local_address))
+    })
 }
 
 /// Set that all sockets have `SO_KEEPALIVE` set with the supplied duration.
@@ -481,10 +525,9 @@ pub unsafe extern "C" fn client_builder_tcp_keepalive(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.tcp_keepalive(u64_to_millis_duration(millisecond));
-
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.tcp_keepalive(u64_to_millis_duration(millisecond)))
+    })
 }
 
 // TLS options
@@ -531,8 +574,7 @@ pub unsafe extern "C" fn client_builder_add_root_certificate(
         }
     };
 
-    let r_client_builder = Box::from_raw(handle);
-    Box::into_raw(Box::new(r_client_builder.add_root_certificate(cert)))
+    update_in_place(handle, |c| c.with_inner(|b| b.add_root_certificate(cert)))
 }
 
 /// Controls the use of built-in system certificates during certificate validation.
@@ -556,9 +598,9 @@ pub unsafe extern "C" fn client_builder_tls_built_in_root_certs(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.tls_built_in_root_certs(tls_built_in_root_certs);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.tls_built_in_root_certs(tls_built_in_root_certs))
+    })
 }
 
 /// Controls the use of certificate validation.
@@ -585,9 +627,9 @@ pub unsafe extern "C" fn client_builder_danger_accept_invalid_certs(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.danger_accept_invalid_certs(accept_invalid_certs);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.danger_accept_invalid_certs(accept_invalid_certs))
+    })
 }
 
 /// Controls the use of TLS server name indication.
@@ -606,9 +648,7 @@ pub unsafe extern "C" fn client_builder_tls_sni(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.tls_sni(tls_sni);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.tls_sni(tls_sni)))
 }
 
 /// Set the minimum required TLS version for connections.
@@ -649,8 +689,7 @@ pub unsafe extern "C" fn client_builder_min_tls_version(
         }
     };
 
-    let result: ClientBuilder = Box::from_raw(handle).min_tls_version(r_version);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.min_tls_version(r_version)))
 }
 
 /// Set the maximum allowed TLS version for connections.
@@ -691,8 +730,7 @@ pub unsafe extern "C" fn client_builder_max_tls_version(
         }
     };
 
-    let result: ClientBuilder = Box::from_raw(handle).max_tls_version(r_version);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.max_tls_version(r_version)))
 }
 
 /// Disables the trust-dns async resolver.
@@ -712,9 +750,7 @@ pub unsafe extern "C" fn client_builder_no_trust_dns(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.no_hickory_dns();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.no_hickory_dns()))
 }
 
 #[no_mangle]
@@ -729,9 +765,7 @@ pub unsafe extern "C" fn client_builder_no_hickory_dns(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.no_hickory_dns();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.no_hickory_dns()))
 }
 
 #[no_mangle]
@@ -747,9 +781,7 @@ pub unsafe extern "C" fn client_builder_hickory_dns(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.hickory_dns(enable);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.hickory_dns(enable)))
 }
 
 /// Restrict the Client to be used with HTTPS only requests.
@@ -768,9 +800,7 @@ pub unsafe extern "C" fn client_builder_https_only(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.https_only(enable);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.https_only(enable)))
 }
 
 /// Override DNS resolution for specific domains to a particular IP address.
@@ -818,8 +848,9 @@ pub unsafe extern "C" fn client_builder_resolve(
         }
     };
 
-    let result = Box::from_raw(handle).resolve(r_domain, r_socket_addr);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.resolve(r_domain, r_socket_addr))
+    })
 }
 
 /// Override DNS resolution for specific domains to particular IP addresses.
@@ -875,8 +906,9 @@ pub unsafe extern "C" fn client_builder_resolve_to_addrs(
         r_socket_addrs.push(r_socket_addr)
     }
 
-    let result = Box::from_raw(handle).resolve_to_addrs(r_domain, &r_socket_addrs);
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| {
+        c.with_inner(|b| b.resolve_to_addrs(r_domain, &r_socket_addrs))
+    })
 }
 
 ///Generally not required
@@ -926,9 +958,7 @@ pub unsafe extern "C" fn client_builder_use_rustls(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.use_rustls_tls();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.use_rustls_tls()))
 }
 
 #[no_mangle]
@@ -943,9 +973,7 @@ pub unsafe extern "C" fn client_builder_use_native_tls(
         return ptr::null_mut();
     }
 
-    let r_client_builder = Box::from_raw(handle);
-    let result = r_client_builder.use_native_tls();
-    Box::into_raw(Box::new(result))
+    update_in_place(handle, |c| c.with_inner(|b| b.use_native_tls()))
 }
 
 //It is usually necessary to use
@@ -1208,6 +1236,121 @@ pub unsafe extern "C" fn client_request(
     Box::into_raw(Box::new(rb))
 }
 
+/// A `RequestBuilder` for the `len` byte URL at `url`, which needs no NUL.
+/// The parsed `Url` is handed to reqwest so it isn't parsed twice.
+unsafe fn request_len(
+    handle: *mut Client,
+    method: Method,
+    url: *const u8,
+    len: usize,
+    what: &str,
+) -> *mut RequestBuilder {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client handle is null when use {}", what),
+        );
+        return ptr::null_mut();
+    }
+
+    let r_value = match to_rust_str_span(url, len, "url parse error") {
+        Some(v) => v,
+        None => {
+            return ptr::null_mut();
+        }
+    };
+    let r_url = match Url::parse(r_value) {
+        Ok(v) => v,
+        Err(_) => {
+            update_last_error(HttpErrorKind::Other, anyhow!("url illegality"));
+            return ptr::null_mut();
+        }
+    };
+
+    let rb = (*handle).request(method, r_url);
+    Box::into_raw(Box::new(rb))
+}
+
+/// Same as `client_get` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_get_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::GET, url, len, "get_len")
+}
+
+/// Same as `client_post` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_post_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::POST, url, len, "post_len")
+}
+
+/// Same as `client_put` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_put_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::PUT, url, len, "put_len")
+}
+
+/// Same as `client_patch` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_patch_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::PATCH, url, len, "patch_len")
+}
+
+/// Same as `client_delete` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_delete_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::DELETE, url, len, "delete_len")
+}
+
+/// Same as `client_head` with a `len` byte URL, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_head_len(
+    handle: *mut Client,
+    url: *const u8,
+    len: usize,
+) -> *mut RequestBuilder {
+    request_len(handle, Method::HEAD, url, len, "head_len")
+}
+
+/// Same as `client_request` with lengths, so neither string needs a NUL.
+#[no_mangle]
+pub unsafe extern "C" fn client_request_len(
+    handle: *mut Client,
+    method: *const u8,
+    method_len: usize,
+    url: *const u8,
+    url_len: usize,
+) -> *mut RequestBuilder {
+    let r_method = match Method::from_bytes(to_rust_bytes(method, method_len)) {
+        Ok(v) => v,
+        Err(e) => {
+            update_last_error(HttpErrorKind::Other, Error::new(e));
+            return ptr::null_mut();
+        }
+    };
+
+    request_len(handle, r_method, url, url_len, "request_len")
+}
+
 /// Executes a `Request`.
 ///
 /// A `Request` can be built manually with `Request::new()` or obtained
@@ -1237,12 +1380,12 @@ pub unsafe extern "C" fn client_execute(
 
     let req = Box::from_raw(request);
     let url = req.url().to_string();
-    let result = client.execute(*req);
+    let result = runtime::block_on(|| client.execute(*req));
     let resp = match result {
         Ok(v) => {
             let resp = response::Response::new(Some(v));
             Box::into_raw(Box::new(resp))
-        },
+        }
         Err(err) => {
             update_last_error(
                 HttpErrorKind::Other,
@@ -1264,6 +1407,92 @@ pub unsafe extern "C" fn client_execute(
     resp
 }
 
+/// Executes `len` requests concurrently, at most `max_in_flight` at a time
+/// (0 means no limit), and blocks until all of them have finished.
+///
+/// Every `Request` in `requests` is consumed. `responses` must have room for
+/// `len` handles; `responses[i]` receives the `Response` for `requests[i]`,
+/// or null if that request failed, in which case the last error describes
+/// the most recent failure.
+///
+/// Returns `false` only if the batch itself could not be run.
+#[no_mangle]
+pub unsafe extern "C" fn client_execute_batch(
+    handle: *mut Client,
+    requests: *const *mut Request,
+    len: usize,
+    max_in_flight: usize,
+    responses: *mut *mut response::Response,
+) -> bool {
+    if handle.is_null() || (len > 0 && (requests.is_null() || responses.is_null())) {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client handle, requests or responses is null when use execute_batch"),
+        );
+        return false;
+    }
+
+    let client = Box::from_raw(handle);
+    let requests = slice::from_raw_parts(requests, len);
+    let responses = slice::from_raw_parts_mut(responses, len);
+
+    let mut batch = Vec::with_capacity(len);
+    for (i, &request) in requests.iter().enumerate() {
+        responses[i] = ptr::null_mut();
+        if request.is_null() {
+            update_last_error(
+                HttpErrorKind::HttpHandleNull,
+                anyhow!("request {} is null when use execute_batch", i),
+            );
+            continue;
+        }
+        batch.push((i, *Box::from_raw(request)));
+    }
+
+    let limit = if max_in_flight == 0 {
+        len.max(1)
+    } else {
+        max_in_flight
+    };
+    let results = runtime::block_on(|| {
+        futures_util::stream::iter(batch)
+            .map(|(i, req)| {
+                let url = req.url().to_string();
+                client.execute(req).map(move |result| (i, url, result))
+            })
+            .buffer_unordered(limit)
+            .collect::<Vec<_>>()
+    });
+
+    for (i, url, result) in results {
+        match result {
+            Ok(v) => {
+                let resp = response::Response::new(Some(v));
+                responses[i] = Box::into_raw(Box::new(resp));
+            }
+            Err(err) => {
+                let mut kind = HttpErrorKind::NoError;
+                utils::parse_err(&err, &mut kind);
+                update_last_error(
+                    kind,
+                    anyhow!(
+                        "{}#{}:{}, {:?}, {}",
+                        extract_file_name(file!()),
+                        function!(),
+                        line!(),
+                        err,
+                        url
+                    ),
+                );
+            }
+        }
+    }
+
+    Box::leak(client);
+
+    true
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -1271,9 +1500,9 @@ mod tests {
     /// url error back when send
     #[test]
     fn into_url_scheme() {
-        let c = reqwest::blocking::Client::new();
+        let c = reqwest::Client::new();
         let req = c.request(Method::GET, "url");
-        let _ = match req.send() {
+        let _ = match runtime::block_on(|| req.send()) {
             Ok(_) => (),
             Err(e) => {
                 print!("{:#?}", e)
@@ -1283,9 +1512,42 @@ mod tests {
 
     #[test]
     fn test_addr() {
-        let cb = reqwest::blocking::ClientBuilder::new();
+        let cb = ClientBuilder::new();
         println!("addr of client_builder new={:p}", &cb);
-        let cb2 = cb.user_agent("AB");
+        let cb2 = cb.with_inner(|b| b.user_agent("AB"));
         println!("addr of client_builder user_agent={:p}", &cb2);
     }
+
+    /// A failed request of a batch keeps the kind of its error.
+    #[test]
+    fn batch_errors_are_classified() {
+        // Accepts connections and never answers.
+        let listener = std::net::TcpListener::bind("127.0.0.1:0").unwrap();
+        let url = format!("http://{}/", listener.local_addr().unwrap());
+        std::thread::spawn(move || {
+            let held: Vec<_> = listener.incoming().collect();
+            drop(held);
+        });
+
+        let mut client = Client::new();
+        let request = client
+            .get(url)
+            .timeout(Duration::from_millis(100))
+            .build()
+            .unwrap();
+        let requests = [Box::into_raw(Box::new(request))];
+        let mut responses = [ptr::null_mut()];
+        unsafe {
+            assert!(client_execute_batch(
+                &mut client,
+                requests.as_ptr(),
+                1,
+                0,
+                responses.as_mut_ptr()
+            ));
+        }
+        assert!(responses[0].is_null());
+        let err = take_last_error().unwrap();
+        assert!(matches!(err.error_kind, HttpErrorKind::HttpTimeout));
+    }
 }
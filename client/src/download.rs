@@ -0,0 +1,744 @@
+//! Segmented downloads: one object fetched over several connections with
+//! HTTP range requests and written in place with positioned writes.
+
+use crate::ffi::*;
+use anyhow::anyhow;
+use file_io::{self, FileWriter, FsyncPolicy};
+use futures_util::future::{self, LocalBoxFuture};
+use futures_util::{FutureExt, StreamExt, TryFutureExt, TryStreamExt};
+use http_err::HttpErrorKind;
+use libc::{c_char, wchar_t};
+use reqwest::header::{
+    HeaderValue, ACCEPT_RANGES, CONTENT_LENGTH, CONTENT_RANGE, ETAG, IF_RANGE, LAST_MODIFIED, RANGE,
+};
+use reqwest::{Client, StatusCode};
+use runtime;
+use std::collections::HashSet;
+use std::ffi::OsString;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::time::Instant;
+use utils;
+
+const DEFAULT_CONNECTIONS: u32 = 4;
+
+const DEFAULT_SEGMENT_SIZE: u64 = 8 * 1024 * 1024;
+
+/// Bytes gathered per segment before each positioned write.
+const WRITE_BUFFER: usize = 1024 * 1024;
+
+const STATE_MAGIC: &str = "crab-download 1";
+
+/// Options for `client_download`. All zeroes is a sensible default.
+#[repr(C)]
+pub struct DownloadOptions {
+    /// Concurrent range requests; 0 means 4.
+    pub connections: u32,
+    /// Bytes per range request; 0 means 8 MiB.
+    pub segment_size: u64,
+    /// Record finished segments in `<path>.crabdl` and skip them when the
+    /// same object is downloaded to the same path again.
+    pub resume: bool,
+    /// Applied to the file before each segment is recorded and at the end.
+    pub fsync: FsyncPolicy,
+}
+
+/// What `client_download` did.
+#[repr(C)]
+#[derive(Default)]
+pub struct DownloadStats {
+    /// Size of the object.
+    pub length: u64,
+    /// Bytes fetched by this call; less than `length` after a resume.
+    pub bytes_fetched: u64,
+    /// Range requests the object was split into; 0 if the server doesn't
+    /// support ranges and it was fetched in one piece.
+    pub segments: u32,
+    /// Segments skipped because an earlier run had finished them.
+    pub segments_resumed: u32,
+    pub elapsed_us: u64,
+}
+
+enum DownloadError {
+    Http(reqwest::Error),
+    Io(io::Error),
+    Protocol(String),
+}
+
+impl From<reqwest::Error> for DownloadError {
+    fn from(e: reqwest::Error) -> Self {
+        DownloadError::Http(e)
+    }
+}
+
+impl From<io::Error> for DownloadError {
+    fn from(e: io::Error) -> Self {
+        DownloadError::Io(e)
+    }
+}
+
+struct Probe {
+    length: Option<u64>,
+    ranges: bool,
+    validator: Option<String>,
+}
+
+fn probe(client: &Client, url: &str) -> Result<Probe, DownloadError> {
+    let resp = runtime::block_on(|| client.head(url).send())?.error_for_status()?;
+    let headers = resp.headers();
+
+    // `content_length()` is the body size hint, always 0 for HEAD.
+    let length = headers
+        .get(CONTENT_LENGTH)
+        .and_then(|v| v.to_str().ok())
+        .and_then(|v| v.parse().ok());
+    let ranges = headers
+        .get(ACCEPT_RANGES)
+        .map_or(false, |v| v.as_bytes().eq_ignore_ascii_case(b"bytes"));
+    // Only a strong ETag or a Last-Modified date can guard If-Range.
+    let validator = headers
+        .get(ETAG)
+        .filter(|v| !v.as_bytes().starts_with(b"W/"))
+        .or_else(|| headers.get(LAST_MODIFIED))
+        .and_then(|v| v.to_str().ok())
+        .map(|v| v.to_string());
+
+    Ok(Probe {
+        length,
+        ranges,
+        validator,
+    })
+}
+
+fn state_path(path: &Path) -> PathBuf {
+    let mut state = OsString::from(path.as_os_str());
+    state.push(".crabdl");
+    PathBuf::from(state)
+}
+
+/// First lines of the state file: a resume only trusts records made for the
+/// same object split the same way.
+fn state_header(length: u64, segment_size: u64, validator: &str) -> String {
+    format!(
+        "{}\nlength {}\nsegment {}\nvalidator {}\n",
+        STATE_MAGIC, length, segment_size, validator
+    )
+}
+
+/// Segments an earlier run recorded as done, if its state file starts with
+/// `header`.
+fn load_done(state: &Path, header: &str) -> Option<HashSet<u64>> {
+    let text = fs::read_to_string(state).ok()?;
+    if !text.starts_with(header) {
+        return None;
+    }
+
+    Some(
+        text[header.len()..]
+            .lines()
+            .filter(|line| line.starts_with("done "))
+            .filter_map(|line| line[5..].parse().ok())
+            .collect(),
+    )
+}
+
+/// First and last byte of segment `i`.
+fn segment_range(i: u64, segment_size: u64, length: u64) -> (u64, u64) {
+    let start = i * segment_size;
+    (start, (start + segment_size).min(length) - 1)
+}
+
+/// Whether a 206 carries exactly bytes `start..=end` of an object of
+/// `length` bytes; anything else would be written at the wrong offset.
+fn is_content_range(value: Option<&HeaderValue>, start: u64, end: u64, length: u64) -> bool {
+    let value = match value.and_then(|v| v.to_str().ok()) {
+        Some(v) => v.trim(),
+        None => return false,
+    };
+    if value.len() < 6 || !value[..6].eq_ignore_ascii_case("bytes ") {
+        return false;
+    }
+    let mut parts = value[6..].splitn(2, '/');
+    let range = parts.next().unwrap_or("");
+    let total = parts.next().and_then(|v| v.parse::<u64>().ok());
+    let mut bounds = range.splitn(2, '-').map(|v| v.parse::<u64>().ok());
+    let first = bounds.next().and_then(|v| v);
+    let last = bounds.next().and_then(|v| v);
+    first == Some(start) && last == Some(end) && total == Some(length)
+}
+
+/// Fetch bytes `start..=end` of the `length` byte object and write them at
+/// the same offset of `file`.
+fn fetch_segment<'a>(
+    client: &Client,
+    url: &str,
+    validator: Option<&str>,
+    file: &'a File,
+    start: u64,
+    end: u64,
+    length: u64,
+) -> LocalBoxFuture<'a, Result<u64, DownloadError>> {
+    let mut request = client
+        .get(url)
+        .header(RANGE, format!("bytes={}-{}", start, end));
+    if let Some(v) = validator {
+        request = request.header(IF_RANGE, v);
+    }
+
+    let limit = end + 1;
+    request
+        .send()
+        .map_err(DownloadError::Http)
+        .and_then(move |resp| {
+            if resp.status() != StatusCode::PARTIAL_CONTENT {
+                let err = DownloadError::Protocol(format!(
+                    "expected 206 for bytes {}-{}, got {}",
+                    start,
+                    end,
+                    resp.status()
+                ));
+                return future::err(err).left_future();
+            }
+            if !is_content_range(resp.headers().get(CONTENT_RANGE), start, end, length) {
+                let err = DownloadError::Protocol(format!(
+                    "expected Content-Range bytes {}-{}/{}, got {:?}",
+                    start,
+                    end,
+                    length,
+                    resp.headers().get(CONTENT_RANGE)
+                ));
+                return future::err(err).left_future();
+            }
+
+            resp.bytes_stream()
+                .map_err(DownloadError::Http)
+                .try_fold(
+                    (Vec::with_capacity(WRITE_BUFFER), start),
+                    move |(mut buf, offset), chunk| {
+                        buf.extend_from_slice(&chunk);
+                        let res = if offset + buf.len() as u64 > limit {
+                            Err(DownloadError::Protocol(format!(
+                                "server sent more than bytes {}-{}",
+                                start, end
+                            )))
+                        } else if buf.len() >= WRITE_BUFFER {
+                            match file_io::write_all_at(file, &buf, offset) {
+                                Ok(()) => {
+                                    let next = offset + buf.len() as u64;
+                                    buf.clear();
+                                    Ok((buf, next))
+                                }
+                                Err(e) => Err(DownloadError::Io(e)),
+                            }
+                        } else {
+                            Ok((buf, offset))
+                        };
+                        future::ready(res)
+                    },
+                )
+                .and_then(move |(buf, offset)| {
+                    let res = match file_io::write_all_at(file, &buf, offset) {
+                        Ok(()) if offset + buf.len() as u64 == limit => Ok(limit - start),
+                        Ok(()) => Err(DownloadError::Protocol(format!(
+                            "connection closed within bytes {}-{}",
+                            start, end
+                        ))),
+                        Err(e) => Err(DownloadError::Io(e)),
+                    };
+                    future::ready(res)
+                })
+                .right_future()
+        })
+        .boxed_local()
+}
+
+fn sync(file: &File, fsync: FsyncPolicy) -> io::Result<()> {
+    match fsync {
+        FsyncPolicy::None => Ok(()),
+        FsyncPolicy::Data => file.sync_data(),
+        FsyncPolicy::All => file.sync_all(),
+    }
+}
+
+/// Plain GET for servers that don't do ranges.
+fn fetch_whole(
+    client: &Client,
+    url: &str,
+    path: &Path,
+    options: &DownloadOptions,
+) -> Result<u64, DownloadError> {
+    let resp = runtime::block_on(|| client.get(url).send())?.error_for_status()?;
+    let (file, _) = file_io::create(path, false)?;
+    let length = resp.content_length();
+    if let Some(len) = length {
+        file_io::preallocate(&file, len)?;
+    }
+
+    let mut writer = FileWriter::new(file, file_io::DEFAULT_WRITE_SIZE, false, length.is_some());
+    runtime::block_on(|| {
+        resp.bytes_stream()
+            .map_err(DownloadError::Http)
+            .try_for_each(|chunk| future::ready(writer.write(&chunk).map_err(DownloadError::Io)))
+    })?;
+
+    Ok(writer.finish(options.fsync)?.bytes_written)
+}
+
+fn download(
+    client: &Client,
+    url: &str,
+    path: &Path,
+    options: &DownloadOptions,
+) -> Result<DownloadStats, DownloadError> {
+    let started = Instant::now();
+    let connections = match options.connections {
+        0 => DEFAULT_CONNECTIONS,
+        v => v,
+    };
+    let segment_size = match options.segment_size {
+        0 => DEFAULT_SEGMENT_SIZE,
+        v => v,
+    };
+
+    let probe = probe(client, url)?;
+    let state = state_path(path);
+    let length = match probe.length {
+        Some(v) if probe.ranges && v > 0 => v,
+        _ => {
+            let fetched = fetch_whole(client, url, path, options)?;
+            let _ = fs::remove_file(&state);
+            return Ok(DownloadStats {
+                length: fetched,
+                bytes_fetched: fetched,
+                elapsed_us: started.elapsed().as_micros() as u64,
+                ..Default::default()
+            });
+        }
+    };
+
+    let segments = (length + segment_size - 1) / segment_size;
+    let header = state_header(
+        length,
+        segment_size,
+        probe.validator.as_ref().map_or("", |v| v.as_str()),
+    );
+
+    // Without a validator there is no telling whether the object changed
+    // since the last run, so it starts over.
+    let earlier = if options.resume && probe.validator.is_some() {
+        load_done(&state, &header).and_then(|done| {
+            OpenOptions::new()
+                .write(true)
+                .open(path)
+                .ok()
+                .map(|f| (f, done))
+        })
+    } else {
+        None
+    };
+
+    let resumed = earlier.is_some();
+    let (file, done) = match earlier {
+        Some(v) => v,
+        None => {
+            let (file, _) = file_io::create(path, false)?;
+            file_io::preallocate(&file, length)?;
+            file.set_len(length)?;
+            (file, HashSet::new())
+        }
+    };
+
+    let mut log = if !options.resume {
+        None
+    } else if resumed {
+        Some(OpenOptions::new().append(true).open(&state)?)
+    } else {
+        let mut log = File::create(&state)?;
+        log.write_all(header.as_bytes())?;
+        Some(log)
+    };
+
+    let todo: Vec<u64> = (0..segments).filter(|i| !done.contains(i)).collect();
+    let segments_resumed = segments - todo.len() as u64;
+    let validator = probe.validator.as_ref().map(|v| v.as_str());
+    let file = &file;
+    let mut bytes_fetched = 0;
+
+    runtime::block_on(|| {
+        futures_util::stream::iter(todo)
+            .map(|i| {
+                let (start, end) = segment_range(i, segment_size, length);
+                fetch_segment(client, url, validator, file, start, end, length)
+                    .map_ok(move |n| (i, n))
+            })
+            .buffer_unordered(connections as usize)
+            .try_for_each(|(i, n)| {
+                bytes_fetched += n;
+                let res = match log {
+                    Some(ref mut log) => sync(file, options.fsync)
+                        .and_then(|_| writeln!(log, "done {}", i))
+                        .map_err(DownloadError::Io),
+                    None => Ok(()),
+                };
+                future::ready(res)
+            })
+    })?;
+
+    sync(file, options.fsync)?;
+    drop(log);
+    let _ = fs::remove_file(&state);
+
+    Ok(DownloadStats {
+        length,
+        bytes_fetched,
+        segments: segments as u32,
+        segments_resumed: segments_resumed as u32,
+        elapsed_us: started.elapsed().as_micros() as u64,
+    })
+}
+
+unsafe fn download_to(
+    handle: *mut Client,
+    url: *const c_char,
+    path: &Path,
+    options: *const DownloadOptions,
+    stats: *mut DownloadStats,
+) -> bool {
+    let r_url = match to_rust_str(url, "parse url error") {
+        Some(v) => v,
+        None => {
+            return false;
+        }
+    };
+
+    let default_options = DownloadOptions {
+        connections: 0,
+        segment_size: 0,
+        resume: false,
+        fsync: FsyncPolicy::None,
+    };
+    let options = if options.is_null() {
+        &default_options
+    } else {
+        &*options
+    };
+
+    let client = Box::from_raw(handle);
+    let result = download(&client, r_url, path, options);
+    Box::leak(client);
+
+    match result {
+        Ok(v) => {
+            if !stats.is_null() {
+                *stats = v;
+            }
+            true
+        }
+        Err(DownloadError::Http(e)) => {
+            let mut kind = HttpErrorKind::NoError;
+            utils::parse_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e));
+
+            false
+        }
+        Err(DownloadError::Io(e)) => {
+            let mut kind = HttpErrorKind::Other;
+            utils::parse_io_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e).context("download failed"));
+
+            false
+        }
+        Err(DownloadError::Protocol(e)) => {
+            update_last_error(HttpErrorKind::InvalidData, anyhow!(e));
+
+            false
+        }
+    }
+}
+
+/// Download `url` to the file at `path`, split into `segment_size` range
+/// requests of which `connections` run at once, each written in place.
+///
+/// A HEAD request finds the size first; servers without range support get
+/// a single plain GET instead. `options` may be null for defaults; `stats`
+/// may be null. Returns `false` on failure, which leaves a partial file and,
+/// with `resume`, the state to continue from.
+#[no_mangle]
+pub unsafe extern "C" fn client_download(
+    handle: *mut Client,
+    url: *const c_char,
+    path: *const c_char,
+    options: *const DownloadOptions,
+    stats: *mut DownloadStats,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client handle is null when use download"),
+        );
+        return false;
+    }
+
+    let r_path = match to_rust_str(path, "parse download path error") {
+        Some(v) => v,
+        None => {
+            return false;
+        }
+    };
+
+    download_to(handle, url, Path::new(r_path), options, stats)
+}
+
+/// Same as `client_download`, with a wide-character path.
+#[cfg(target_os = "windows")]
+#[no_mangle]
+pub unsafe extern "C" fn client_download_wide(
+    handle: *mut Client,
+    url: *const c_char,
+    path: *const wchar_t,
+    length: usize,
+    options: *const DownloadOptions,
+    stats: *mut DownloadStats,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client handle is null when use download"),
+        );
+        return false;
+    }
+
+    let r_path = match to_rust_str_wide(path, length) {
+        Some(v) => v,
+        None => {
+            return false;
+        }
+    };
+
+    download_to(handle, url, Path::new(&r_path), options, stats)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Read;
+    use std::net::{TcpListener, TcpStream};
+    use std::thread;
+    use std::time::Duration;
+
+    /// Per-connection bandwidth of the test server, standing in for a
+    /// server or path that caps each TCP stream.
+    const RATE: usize = 16 * 1024 * 1024;
+
+    fn pattern(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i * 31 % 251) as u8).collect()
+    }
+
+    fn respond(
+        stream: &mut TcpStream,
+        head: &str,
+        data: &[u8],
+        body: &[u8],
+        shift: usize,
+    ) -> io::Result<()> {
+        let range = head
+            .lines()
+            .find(|line| line.to_ascii_lowercase().starts_with("range: bytes="))
+            .map(|line| {
+                let spec = &line["range: bytes=".len()..];
+                let mut parts = spec.splitn(2, '-');
+                let start: usize = parts.next().unwrap().trim().parse().unwrap();
+                let end: usize = parts.next().unwrap().trim().parse().unwrap();
+                let end = (end + shift).min(data.len() - 1);
+                ((start + shift).min(end), end)
+            });
+
+        let (status, payload) = match range {
+            Some((start, end)) => (
+                format!(
+                    "206 Partial Content\r\nContent-Range: bytes {}-{}/{}",
+                    start,
+                    end,
+                    data.len()
+                ),
+                &data[start..=end],
+            ),
+            None => ("200 OK".to_string(), data),
+        };
+        write!(
+            stream,
+            "HTTP/1.1 {}\r\nAccept-Ranges: bytes\r\nETag: \"v1\"\r\nContent-Length: {}\r\n\r\n",
+            status,
+            payload.len()
+        )?;
+        if head.starts_with("HEAD ") {
+            return Ok(());
+        }
+
+        for piece in payload.chunks(body.len()) {
+            let t = Instant::now();
+            stream.write_all(piece)?;
+            let budget = Duration::from_secs_f64(piece.len() as f64 / RATE as f64);
+            if let Some(rest) = budget.checked_sub(t.elapsed()) {
+                thread::sleep(rest);
+            }
+        }
+        Ok(())
+    }
+
+    /// Keep-alive server for `data` answering single byte ranges with the
+    /// range `shift` bytes further on, which is correct for 0.
+    fn serve(data: Vec<u8>, shift: usize) -> String {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+        let data = std::sync::Arc::new(data);
+        thread::spawn(move || {
+            for stream in listener.incoming() {
+                let mut stream = stream.unwrap();
+                let data = data.clone();
+                thread::spawn(move || {
+                    let body = vec![0u8; 64 * 1024];
+                    let mut buf = [0u8; 4096];
+                    let mut pending = Vec::new();
+                    while let Ok(n) = stream.read(&mut buf) {
+                        if n == 0 {
+                            break;
+                        }
+                        pending.extend_from_slice(&buf[..n]);
+                        while let Some(end) = pending.windows(4).position(|w| w == b"\r\n\r\n") {
+                            let head = String::from_utf8_lossy(&pending[..end]).into_owned();
+                            pending.drain(..end + 4);
+                            if respond(&mut stream, &head, &data, &body, shift).is_err() {
+                                return;
+                            }
+                        }
+                    }
+                });
+            }
+        });
+        format!("http://{}/", addr)
+    }
+
+    #[test]
+    fn segments_cover_the_object() {
+        let ranges: Vec<_> = (0..3).map(|i| segment_range(i, 4, 10)).collect();
+        assert_eq!(ranges, [(0, 3), (4, 7), (8, 9)]);
+        assert_eq!(segment_range(0, 8, 8), (0, 7));
+    }
+
+    #[test]
+    fn content_range_must_match_the_request() {
+        let check =
+            |v: &'static str| is_content_range(Some(&HeaderValue::from_static(v)), 4, 7, 10);
+        assert!(check("bytes 4-7/10"));
+        assert!(check("Bytes 4-7/10"));
+        assert!(!check("bytes 5-8/10"), "other range");
+        assert!(!check("bytes 4-7/11"), "other object");
+        assert!(!check("bytes 4-7/*"));
+        assert!(!check("bytes */10"));
+        assert!(!is_content_range(None, 4, 7, 10));
+    }
+
+    #[test]
+    fn resume_trusts_only_the_same_split() {
+        let state = std::env::temp_dir().join(format!("crab-state-{}", std::process::id()));
+        let header = state_header(10, 4, "\"v1\"");
+        fs::write(&state, header.clone() + "done 0\ndone 2\ndone x\n").unwrap();
+
+        let done = load_done(&state, &header).unwrap();
+        assert_eq!(done, [0, 2].iter().cloned().collect());
+        assert!(load_done(&state, &state_header(10, 4, "\"v2\"")).is_none());
+        assert!(load_done(&state, &state_header(10, 5, "\"v1\"")).is_none());
+        assert!(load_done(&state, &state_header(11, 4, "\"v1\"")).is_none());
+
+        let _ = fs::remove_file(&state);
+    }
+
+    #[test]
+    fn misplaced_range_fails_the_download() {
+        let data = pattern(64 * 1024);
+        let client = Client::builder().build().unwrap();
+        let path = std::env::temp_dir().join(format!("crab-misplaced-{}", std::process::id()));
+        let options = DownloadOptions {
+            connections: 2,
+            segment_size: 16 * 1024,
+            resume: false,
+            fsync: FsyncPolicy::None,
+        };
+
+        let stats = download(&client, &serve(data.clone(), 0), &path, &options);
+        assert!(stats.map(|s| s.bytes_fetched).ok() == Some(data.len() as u64));
+        assert!(fs::read(&path).unwrap() == data);
+
+        match download(&client, &serve(data, 1), &path, &options) {
+            Err(DownloadError::Protocol(_)) => {}
+            _ => panic!("a shifted range must fail"),
+        }
+        let _ = fs::remove_file(&path);
+    }
+
+    /// One connection against several on a server that limits each stream,
+    /// checking the downloaded file every time.
+    ///
+    /// cargo test --release bench_segmented_download -- --ignored --nocapture
+    #[test]
+    #[ignore]
+    fn bench_segmented_download() {
+        const LENGTH: usize = 64 * 1024 * 1024;
+
+        let data = pattern(LENGTH);
+        let url = serve(data.clone(), 0);
+        let client = Client::builder().build().unwrap();
+        let path = std::env::temp_dir().join(format!("crab-download-{}", std::process::id()));
+
+        println!("{} MiB, {} MiB/s per connection", LENGTH >> 20, RATE >> 20);
+        for &connections in &[1u32, 2, 4, 8] {
+            let options = DownloadOptions {
+                connections,
+                segment_size: (LENGTH / connections as usize) as u64,
+                resume: false,
+                fsync: FsyncPolicy::None,
+            };
+            let stats = match download(&client, &url, &path, &options) {
+                Ok(v) => v,
+                Err(_) => panic!("download with {} connections failed", connections),
+            };
+            assert_eq!(stats.bytes_fetched, LENGTH as u64);
+            assert!(fs::read(&path).unwrap() == data);
+
+            let secs = stats.elapsed_us as f64 / 1e6;
+            println!(
+                "{} connection(s): {:>7.1} ms  {:>7.1} MiB/s",
+                connections,
+                secs * 1e3,
+                LENGTH as f64 / secs / (1 << 20) as f64
+            );
+        }
+
+        // Interrupted run: drop the record of the last segment and resume.
+        let options = DownloadOptions {
+            connections: 4,
+            segment_size: (LENGTH / 8) as u64,
+            resume: true,
+            fsync: FsyncPolicy::None,
+        };
+        let state = state_path(&path);
+        let header = state_header(LENGTH as u64, (LENGTH / 8) as u64, "\"v1\"");
+        let done: String = (0..7).map(|i| format!("done {}\n", i)).collect();
+        fs::write(&state, header + &done).unwrap();
+
+        let stats = match download(&client, &url, &path, &options) {
+            Ok(v) => v,
+            Err(_) => panic!("resumed download failed"),
+        };
+        assert_eq!(stats.segments_resumed, 7);
+        assert_eq!(stats.bytes_fetched, (LENGTH / 8) as u64);
+        assert!(fs::read(&path).unwrap() == data);
+        assert!(!state.exists());
+
+        let _ = fs::remove_file(&path);
+    }
+}
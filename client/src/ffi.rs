@@ -1,11 +1,11 @@
 //! The foreign function interface which exposes this library to non-Rust
 //! languages.
 
-use anyhow::Error;
-use libc::{c_char, wchar_t};
+use anyhow::{anyhow, Error};
+use libc::{c_char, c_void, wchar_t};
+use serde::ser::{Serialize, SerializeSeq, Serializer};
 use std::cell::RefCell;
-use std::convert::From;
-use std::ffi::{CStr, CString, OsString};
+use std::ffi::{CStr, OsString};
 use std::{ptr, time::Duration, usize};
 
 use http_err::HttpErrorKind;
@@ -19,39 +19,75 @@ thread_local! {
 
 #[repr(C)]
 pub struct Pair {
-    key: *const c_char,
-    value: *const c_char,
+    pub(crate) key: *const c_char,
+    pub(crate) value: *const c_char,
 }
 
-impl From<(String, String)> for Pair {
-    fn from(tup: (String, String)) -> Self {
-        Pair {
-            key: match CString::new(tup.0) {
-                Ok(v) => v.into_raw(),
-                Err(_) => ptr::null(),
-            },
-            value: match CString::new(tup.1) {
-                Ok(v) => v.into_raw(),
-                Err(_) => ptr::null_mut(),
-            },
+/// Caller-owned pairs read in place. They serialize as a sequence of
+/// `(key, value)` tuples, which is what `query`, `form` and `json` expect,
+/// without copying a single string.
+pub struct Pairs<'a>(&'a [Pair]);
+
+impl<'a> Pairs<'a> {
+    /// Borrow `len` pairs once every key and value is checked to be non-null
+    /// UTF-8, or `None` with the last error set.
+    pub unsafe fn new(pairs: *const Pair, len: usize, what: &str) -> Option<Pairs<'a>> {
+        if len == 0 {
+            return Some(Pairs(&[]));
         }
+        if pairs.is_null() {
+            update_last_error(
+                HttpErrorKind::HttpHandleNull,
+                anyhow!("pairs is null when use {}", what),
+            );
+            return None;
+        }
+
+        let pairs = std::slice::from_raw_parts(pairs, len);
+        for pair in pairs {
+            if pair.key.is_null() || pair.value.is_null() {
+                update_last_error(
+                    HttpErrorKind::HttpHandleNull,
+                    anyhow!("pair key or value is null when use {}", what),
+                );
+                return None;
+            }
+            to_rust_str(pair.key, "key parse error")?;
+            to_rust_str(pair.value, "value parse error")?;
+        }
+        Some(Pairs(pairs))
     }
-}
 
-impl From<&Pair> for (String, String) {
-    fn from(tup: &Pair) -> (String, String) {
-        let key = match to_rust_str(tup.key, "key parse error") {
-            Some(v) => v.to_string(),
-            None => String::from(""),
-        };
-        let value = match to_rust_str(tup.value, "value parse error") {
-            Some(v) => v.to_string(),
-            None => String::from(""),
+    /// The pairs as `(key, value)` strings.
+    pub fn iter(&self) -> impl Iterator<Item = (&'a str, &'a str)> {
+        // Checked in `new`.
+        let text = |p: *const c_char| unsafe {
+            std::str::from_utf8_unchecked(CStr::from_ptr(p).to_bytes())
         };
-        (key, value)
+        self.0
+            .iter()
+            .map(move |pair| (text(pair.key), text(pair.value)))
+    }
+}
+
+impl<'a> Serialize for Pairs<'a> {
+    fn serialize<S: Serializer>(&self, serializer: S) -> Result<S::Ok, S::Error> {
+        let mut seq = serializer.serialize_seq(Some(self.0.len()))?;
+        for pair in self.iter() {
+            seq.serialize_element(&pair)?;
+        }
+        seq.end()
     }
 }
 
+/// Opaque caller context handed back to a C callback.
+///
+/// The pointer is only ever passed through, never dereferenced on the Rust
+/// side, so it may travel to a runtime worker thread.
+pub struct UserData(pub *mut c_void);
+
+unsafe impl Send for UserData {}
+
 /// Retrieve the most recent error, clearing it in the process.
 pub fn take_last_error() -> Option<Box<HttpException>> {
     LAST_ERROR.with(|prev| prev.borrow_mut().take())
@@ -96,6 +132,43 @@ pub fn to_rust_str<'a>(ptr: *const c_char, err_tip: &'static str) -> Option<&'a
     }
 }
 
+/// `len` bytes at `data`; null is the empty slice.
+pub unsafe fn to_rust_bytes<'a>(data: *const u8, len: usize) -> &'a [u8] {
+    if data.is_null() {
+        &[]
+    } else {
+        std::slice::from_raw_parts(data, len)
+    }
+}
+
+/// Like `to_rust_str` for `len` bytes at `data`, which need no NUL. Null
+/// with a zero length is the empty string.
+pub fn to_rust_str_span<'a>(data: *const u8, len: usize, err_tip: &'static str) -> Option<&'a str> {
+    if data.is_null() {
+        if len == 0 {
+            return Some("");
+        }
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("data is null with {} bytes", len).context(err_tip),
+        );
+        return None;
+    }
+
+    unsafe {
+        match std::str::from_utf8(to_rust_bytes(data, len)) {
+            Ok(v) => Some(v),
+            Err(e) => {
+                update_last_error(
+                    HttpErrorKind::CharConversion,
+                    Error::new(e).context(err_tip),
+                );
+                None
+            }
+        }
+    }
+}
+
 #[cfg(target_os = "windows")]
 pub fn to_rust_str_wide<'a>(ptr: *const wchar_t, length: usize) -> Option<OsString> {
     if ptr.is_null() {
@@ -121,3 +194,30 @@ pub fn u64_to_millis_duration(millisecond: *const u64) -> Option<Duration> {
 
     unsafe { Some(Duration::from_millis(*millisecond)) }
 }
+
+/// Aborts if dropped, which only happens while unwinding.
+struct AbortOnUnwind;
+
+impl Drop for AbortOnUnwind {
+    fn drop(&mut self) {
+        std::process::abort();
+    }
+}
+
+/// Replace the value behind `handle` with `f(value)` and return `handle`.
+///
+/// reqwest's builders are consumed and returned by value. Doing that inside
+/// the existing box keeps an FFI handle stable across chained calls instead
+/// of freeing it and allocating a new one each time. Fallible parsing must
+/// happen before: `f` always produces the next value.
+pub unsafe fn update_in_place<T, F>(handle: *mut T, f: F) -> *mut T
+where
+    F: FnOnce(T) -> T,
+{
+    // The slot holds a moved-out value while `f` runs; a panic must not
+    // let anything drop it again.
+    let guard = AbortOnUnwind;
+    ptr::write(handle, f(ptr::read(handle)));
+    std::mem::forget(guard);
+    handle
+}
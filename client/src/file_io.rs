@@ -0,0 +1,346 @@
+//! File access for bodies that go straight between disk and the network:
+//! large aligned writes for saving responses, positioned writes for
+//! segmented downloads and read-only mappings for uploads.
+
+use std::alloc::{self, Layout};
+use std::fs::{File, OpenOptions};
+use std::io::{self, Write};
+use std::path::Path;
+use std::time::{Duration, Instant};
+use std::{ptr, slice};
+
+#[cfg(unix)]
+use std::os::unix::io::AsRawFd;
+
+/// Alignment that satisfies `O_DIRECT` on common filesystems.
+pub const IO_ALIGN: usize = 4096;
+
+/// Default size of a single write.
+pub const DEFAULT_WRITE_SIZE: usize = 1024 * 1024;
+
+/// How to flush a written file to stable storage.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum FsyncPolicy {
+    /// Leave it to the page cache.
+    None,
+    /// `fdatasync`: file contents, not metadata such as mtime.
+    Data,
+    /// `fsync`: contents and metadata.
+    All,
+}
+
+/// Heap buffer whose start and capacity are multiples of `IO_ALIGN`.
+struct AlignedBuf {
+    ptr: *mut u8,
+    cap: usize,
+    len: usize,
+}
+
+impl AlignedBuf {
+    fn new(size: usize) -> Self {
+        let cap = ((size.max(1) + IO_ALIGN - 1) / IO_ALIGN) * IO_ALIGN;
+        let layout = Layout::from_size_align(cap, IO_ALIGN).expect("bad write buffer size");
+        let ptr = unsafe { alloc::alloc(layout) };
+        if ptr.is_null() {
+            alloc::handle_alloc_error(layout);
+        }
+        AlignedBuf { ptr, cap, len: 0 }
+    }
+
+    /// Copy as much of `data` as fits, returning the number of bytes taken.
+    fn fill(&mut self, data: &[u8]) -> usize {
+        let n = data.len().min(self.cap - self.len);
+        unsafe { ptr::copy_nonoverlapping(data.as_ptr(), self.ptr.add(self.len), n) };
+        self.len += n;
+        n
+    }
+
+    fn as_slice(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+impl Drop for AlignedBuf {
+    fn drop(&mut self) {
+        unsafe {
+            alloc::dealloc(
+                self.ptr,
+                Layout::from_size_align_unchecked(self.cap, IO_ALIGN),
+            )
+        };
+    }
+}
+
+/// Create or truncate `path` for writing, with `O_DIRECT` if asked for and
+/// the filesystem supports it. Returns whether `O_DIRECT` is in effect.
+pub fn create(path: &Path, direct: bool) -> io::Result<(File, bool)> {
+    let mut options = OpenOptions::new();
+    options.write(true).create(true).truncate(true);
+
+    #[cfg(target_os = "linux")]
+    {
+        if direct {
+            use std::os::unix::fs::OpenOptionsExt;
+
+            let mut direct_options = options.clone();
+            direct_options.custom_flags(libc::O_DIRECT);
+            match direct_options.open(path) {
+                Ok(f) => return Ok((f, true)),
+                // tmpfs and friends reject O_DIRECT; fall back to buffered.
+                Err(ref e) if e.raw_os_error() == Some(libc::EINVAL) => {}
+                Err(e) => return Err(e),
+            }
+        }
+    }
+
+    let _ = direct;
+    options.open(path).map(|f| (f, false))
+}
+
+/// Reserve `len` bytes on disk so the file is laid out contiguously and
+/// writes never fail half way for lack of space. A no-op where unsupported.
+pub fn preallocate(file: &File, len: u64) -> io::Result<()> {
+    #[cfg(target_os = "linux")]
+    {
+        if unsafe { libc::fallocate(file.as_raw_fd(), 0, 0, len as libc::off_t) } != 0 {
+            let err = io::Error::last_os_error();
+            return match err.raw_os_error() {
+                Some(libc::EOPNOTSUPP) | Some(libc::ENOSYS) => Ok(()),
+                _ => Err(err),
+            };
+        }
+    }
+
+    let _ = (file, len);
+    Ok(())
+}
+
+/// Drop `O_DIRECT`, so a final write that is not a multiple of `IO_ALIGN`
+/// is accepted.
+fn clear_direct(file: &File) -> io::Result<()> {
+    #[cfg(target_os = "linux")]
+    {
+        let fd = file.as_raw_fd();
+        unsafe {
+            let flags = libc::fcntl(fd, libc::F_GETFL);
+            if flags < 0 || libc::fcntl(fd, libc::F_SETFL, flags & !libc::O_DIRECT) < 0 {
+                return Err(io::Error::last_os_error());
+            }
+        }
+    }
+
+    let _ = file;
+    Ok(())
+}
+
+/// Time spent in a `FileWriter`, besides the bytes it wrote.
+pub struct WriteStats {
+    pub bytes_written: u64,
+    pub write_time: Duration,
+    pub sync_time: Duration,
+}
+
+/// Gathers incoming chunks into `write_size` aligned writes.
+pub struct FileWriter {
+    file: File,
+    buf: AlignedBuf,
+    direct: bool,
+    preallocated: bool,
+    stats: WriteStats,
+}
+
+impl FileWriter {
+    pub fn new(file: File, write_size: usize, direct: bool, preallocated: bool) -> Self {
+        FileWriter {
+            file,
+            buf: AlignedBuf::new(write_size),
+            direct,
+            preallocated,
+            stats: WriteStats {
+                bytes_written: 0,
+                write_time: Duration::default(),
+                sync_time: Duration::default(),
+            },
+        }
+    }
+
+    pub fn write(&mut self, mut data: &[u8]) -> io::Result<()> {
+        // A chunk at least one buffer long skips the copy when alignment
+        // doesn't matter.
+        if !self.direct && self.buf.len == 0 && data.len() >= self.buf.cap {
+            return self.write_out(data);
+        }
+
+        while !data.is_empty() {
+            let n = self.buf.fill(data);
+            data = &data[n..];
+            if self.buf.len == self.buf.cap {
+                self.flush_buf()?;
+            }
+        }
+        Ok(())
+    }
+
+    fn write_out(&mut self, data: &[u8]) -> io::Result<()> {
+        let started = Instant::now();
+        self.file.write_all(data)?;
+        self.stats.write_time += started.elapsed();
+        self.stats.bytes_written += data.len() as u64;
+        Ok(())
+    }
+
+    fn flush_buf(&mut self) -> io::Result<()> {
+        let started = Instant::now();
+        self.file.write_all(self.buf.as_slice())?;
+        self.stats.write_time += started.elapsed();
+        self.stats.bytes_written += self.buf.len as u64;
+        self.buf.len = 0;
+        Ok(())
+    }
+
+    /// Write what is left, trim any unused preallocation and sync.
+    pub fn finish(mut self, fsync: FsyncPolicy) -> io::Result<WriteStats> {
+        if self.buf.len > 0 {
+            if self.direct && self.buf.len % IO_ALIGN != 0 {
+                clear_direct(&self.file)?;
+            }
+            self.flush_buf()?;
+        }
+
+        if self.preallocated {
+            self.file.set_len(self.stats.bytes_written)?;
+        }
+
+        let started = Instant::now();
+        match fsync {
+            FsyncPolicy::None => {}
+            FsyncPolicy::Data => self.file.sync_data()?,
+            FsyncPolicy::All => self.file.sync_all()?,
+        }
+        self.stats.sync_time = started.elapsed();
+
+        Ok(self.stats)
+    }
+}
+
+/// Write all of `buf` at `offset` without moving the file cursor, so
+/// several writers can fill different parts of one file (`pwrite`).
+pub fn write_all_at(file: &File, buf: &[u8], offset: u64) -> io::Result<()> {
+    #[cfg(unix)]
+    {
+        use std::os::unix::fs::FileExt;
+
+        file.write_all_at(buf, offset)
+    }
+
+    #[cfg(windows)]
+    {
+        use std::os::windows::fs::FileExt;
+
+        let mut buf = buf;
+        let mut offset = offset;
+        while !buf.is_empty() {
+            match file.seek_write(buf, offset) {
+                Ok(0) => return Err(io::Error::from(io::ErrorKind::WriteZero)),
+                Ok(n) => {
+                    buf = &buf[n..];
+                    offset += n as u64;
+                }
+                Err(ref e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(e) => return Err(e),
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Read-only shared mapping of a whole file.
+pub struct Mapping {
+    ptr: *mut u8,
+    len: usize,
+}
+
+// The mapping is never written through, so sharing it is as safe as
+// sharing a `&[u8]`.
+unsafe impl Send for Mapping {}
+unsafe impl Sync for Mapping {}
+
+impl Mapping {
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn as_slice(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr, self.len) }
+    }
+
+    /// Drop the pages of `offset..offset + len` from this process once they
+    /// have been read; they stay in the page cache. `offset` must be a
+    /// multiple of the page size.
+    pub fn release(&self, offset: usize, len: usize) {
+        #[cfg(unix)]
+        unsafe {
+            libc::madvise(
+                self.ptr.add(offset) as *mut libc::c_void,
+                len,
+                libc::MADV_DONTNEED,
+            );
+        }
+
+        let _ = (offset, len);
+    }
+}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        #[cfg(unix)]
+        unsafe {
+            libc::munmap(self.ptr as *mut libc::c_void, self.len);
+        }
+    }
+}
+
+/// Map `file` for one sequential read. `None` for anything that is not a
+/// non-empty regular file (pipes, sockets, devices, ...) or can't be mapped
+/// on this platform; those have to be read instead.
+pub fn map(file: &File) -> io::Result<Option<Mapping>> {
+    let meta = file.metadata()?;
+    if !meta.is_file() || meta.len() == 0 || meta.len() > usize::MAX as u64 {
+        return Ok(None);
+    }
+
+    #[cfg(unix)]
+    {
+        let len = meta.len() as usize;
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            let err = io::Error::last_os_error();
+            return match err.raw_os_error() {
+                // Files on filesystems without mmap support.
+                Some(libc::ENODEV) | Some(libc::EACCES) => Ok(None),
+                _ => Err(err),
+            };
+        }
+
+        // Aggressive readahead, and pages behind the reader may be reclaimed
+        // early.
+        unsafe { libc::madvise(ptr, len, libc::MADV_SEQUENTIAL) };
+        return Ok(Some(Mapping {
+            ptr: ptr as *mut u8,
+            len,
+        }));
+    }
+
+    #[cfg(not(unix))]
+    Ok(None)
+}
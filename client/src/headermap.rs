@@ -1,10 +1,14 @@
 use crate::ffi::*;
 use anyhow::{anyhow, Error};
+use bytes::Bytes;
+use caller_alloc::Allocator;
 use http_err::HttpErrorKind;
 use libc::c_char;
-use reqwest::header::{HeaderMap, HeaderValue};
+use meta::{alloc_owned, free_owned, write_headers, HeaderSpan};
+use reqwest::header::{HeaderMap, HeaderName, HeaderValue};
 use rust_string::RString;
-use std::ptr;
+use std::ffi::CStr;
+use std::{ptr, slice};
 
 #[no_mangle]
 pub unsafe extern "C" fn new_header_map() -> *mut HeaderMap {
@@ -126,6 +130,328 @@ pub unsafe extern "C" fn header_map_append(
     true
 }
 
+/// Same as `header_map_insert` with `key_len` and `value_len` bytes, which
+/// need no NUL. Both are validated as bytes, without a UTF-8 check.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_insert_len(
+    handle: *mut HeaderMap,
+    key: *const u8,
+    key_len: usize,
+    value: *const u8,
+    value_len: usize,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return false;
+    }
+
+    match parse_header(to_rust_bytes(key, key_len), to_rust_bytes(value, value_len)) {
+        Some((name, value)) => {
+            (*handle).insert(name, value);
+            true
+        }
+        None => false,
+    }
+}
+
+/// Same as `header_map_append` with `key_len` and `value_len` bytes, which
+/// need no NUL. Both are validated as bytes, without a UTF-8 check.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_append_len(
+    handle: *mut HeaderMap,
+    key: *const u8,
+    key_len: usize,
+    value: *const u8,
+    value_len: usize,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return false;
+    }
+
+    match parse_header(to_rust_bytes(key, key_len), to_rust_bytes(value, value_len)) {
+        Some((name, value)) => {
+            (*handle).append(name, value);
+            true
+        }
+        None => false,
+    }
+}
+
+/// Parse `len` pairs into a map, keeping every value of a repeated name.
+/// Nothing is returned unless all of them are valid.
+pub(crate) unsafe fn parse_pairs(pairs: *const Pair, len: usize, what: &str) -> Option<HeaderMap> {
+    if len == 0 {
+        return Some(HeaderMap::new());
+    }
+    if pairs.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("pairs is null when use {}", what),
+        );
+        return None;
+    }
+
+    let mut map = HeaderMap::with_capacity(len);
+    for pair in slice::from_raw_parts(pairs, len) {
+        if pair.key.is_null() || pair.value.is_null() {
+            update_last_error(
+                HttpErrorKind::HttpHandleNull,
+                anyhow!("pair key or value is null when use {}", what),
+            );
+            return None;
+        }
+        let (name, value) = parse_header(
+            CStr::from_ptr(pair.key).to_bytes(),
+            CStr::from_ptr(pair.value).to_bytes(),
+        )?;
+        map.append(name, value);
+    }
+    Some(map)
+}
+
+/// Validate one header given as bytes, or `None` with the last error set.
+pub(crate) fn parse_header(key: &[u8], value: &[u8]) -> Option<(HeaderName, HeaderValue)> {
+    let name = match HeaderName::from_bytes(key) {
+        Ok(v) => v,
+        Err(e) => {
+            let err = format!(
+                "{} convert to header name failed. {e}",
+                String::from_utf8_lossy(key)
+            );
+            update_last_error(HttpErrorKind::Other, anyhow!(err));
+            return None;
+        }
+    };
+    let value = match HeaderValue::from_bytes(value) {
+        Ok(v) => v,
+        Err(e) => {
+            let err = format!(
+                "{} convert to header failed. {e}",
+                String::from_utf8_lossy(value)
+            );
+            update_last_error(HttpErrorKind::Other, anyhow!(err));
+            return None;
+        }
+    };
+    Some((name, value))
+}
+
+/// Insert every entry of `src` into `dst`, replacing the values `dst` had
+/// for those names and keeping each value of a name repeated in `src`.
+pub(crate) fn merge(dst: &mut HeaderMap, src: HeaderMap) {
+    let mut last = None;
+    for (name, value) in src {
+        match name {
+            Some(name) => {
+                dst.insert(name.clone(), value);
+                last = Some(name);
+            }
+            None => {
+                if let Some(ref name) = last {
+                    dst.append(name, value);
+                }
+            }
+        }
+    }
+}
+
+/// Validate and insert `len` pairs in one call. Names already in the map
+/// lose their old values; a name repeated in `pairs` keeps all of its own.
+///
+/// The map is untouched and `false` is returned if any pair is invalid.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_insert_many(
+    handle: *mut HeaderMap,
+    pairs: *const Pair,
+    len: usize,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return false;
+    }
+
+    match parse_pairs(pairs, len, "insert_many") {
+        Some(parsed) => {
+            merge(&mut *handle, parsed);
+            true
+        }
+        None => false,
+    }
+}
+
+/// Validate a header name once, for reuse by the `_interned` functions
+/// without parsing it again. Names are lowercased. Release it with
+/// `header_name_destroy`; it may be shared by threads until then.
+///
+/// Returns null if `name` is not a valid header name.
+#[no_mangle]
+pub unsafe extern "C" fn header_name_new(name: *const c_char) -> *mut HeaderName {
+    if name.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("name is null when use header_name_new"),
+        );
+        return ptr::null_mut();
+    }
+
+    let bytes = CStr::from_ptr(name).to_bytes();
+    match HeaderName::from_bytes(bytes) {
+        Ok(v) => Box::into_raw(Box::new(v)),
+        Err(e) => {
+            let err = format!(
+                "{} convert to header name failed. {e}",
+                String::from_utf8_lossy(bytes)
+            );
+            update_last_error(HttpErrorKind::Other, anyhow!(err));
+            ptr::null_mut()
+        }
+    }
+}
+
+/// Same as `header_name_new` with `len` bytes, which need no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn header_name_new_len(name: *const u8, len: usize) -> *mut HeaderName {
+    if name.is_null() && len > 0 {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("name is null when use header_name_new_len"),
+        );
+        return ptr::null_mut();
+    }
+
+    let bytes = to_rust_bytes(name, len);
+    match HeaderName::from_bytes(bytes) {
+        Ok(v) => Box::into_raw(Box::new(v)),
+        Err(e) => {
+            let err = format!(
+                "{} convert to header name failed. {e}",
+                String::from_utf8_lossy(bytes)
+            );
+            update_last_error(HttpErrorKind::Other, anyhow!(err));
+            ptr::null_mut()
+        }
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn header_name_destroy(handle: *mut HeaderName) {
+    if handle.is_null() {
+        return;
+    }
+    drop(Box::from_raw(handle));
+}
+
+unsafe fn header_value_with(data: *const u8, len: usize, bytes: Bytes) -> *mut HeaderValue {
+    match HeaderValue::from_maybe_shared(bytes) {
+        Ok(v) => Box::into_raw(Box::new(v)),
+        Err(e) => {
+            let text = String::from_utf8_lossy(slice::from_raw_parts(data, len));
+            let err = format!("{text} convert to header failed. {e}");
+            update_last_error(HttpErrorKind::Other, anyhow!(err));
+            ptr::null_mut()
+        }
+    }
+}
+
+/// Validate `len` bytes as a header value once, copying them, for reuse by
+/// the `_interned` functions. Release it with `header_value_destroy`.
+///
+/// Returns null if the bytes are not a valid header value.
+#[no_mangle]
+pub unsafe extern "C" fn header_value_new(data: *const u8, len: usize) -> *mut HeaderValue {
+    if data.is_null() && len != 0 {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("data is null when use header_value_new"),
+        );
+        return ptr::null_mut();
+    }
+
+    let bytes = match len {
+        0 => Bytes::new(),
+        _ => Bytes::copy_from_slice(slice::from_raw_parts(data, len)),
+    };
+    header_value_with(data, len, bytes)
+}
+
+/// Like `header_value_new` without the copy: the value refers to `data`,
+/// which must stay unchanged for the rest of the process, such as a string
+/// literal.
+#[no_mangle]
+pub unsafe extern "C" fn header_value_from_static(data: *const u8, len: usize) -> *mut HeaderValue {
+    if data.is_null() && len != 0 {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("data is null when use header_value_from_static"),
+        );
+        return ptr::null_mut();
+    }
+
+    let bytes = match len {
+        0 => Bytes::new(),
+        _ => Bytes::from_static(slice::from_raw_parts(data, len)),
+    };
+    header_value_with(data, len, bytes)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn header_value_destroy(handle: *mut HeaderValue) {
+    if handle.is_null() {
+        return;
+    }
+    drop(Box::from_raw(handle));
+}
+
+/// `header_map_insert` with an interned name and value, which are only
+/// cloned.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_insert_interned(
+    handle: *mut HeaderMap,
+    name: *const HeaderName,
+    value: *const HeaderValue,
+) -> bool {
+    if handle.is_null() || name.is_null() || value.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map, name or value is null when use insert_interned"),
+        );
+        return false;
+    }
+
+    (*handle).insert(&*name, (*value).clone());
+    true
+}
+
+/// `header_map_append` with an interned name and value, which are only
+/// cloned.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_append_interned(
+    handle: *mut HeaderMap,
+    name: *const HeaderName,
+    value: *const HeaderValue,
+) -> bool {
+    if handle.is_null() || name.is_null() || value.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map, name or value is null when use append_interned"),
+        );
+        return false;
+    }
+
+    (*handle).append(&*name, (*value).clone());
+    true
+}
+
 /// Removes a key from the map, returning the value associated with the key.
 ///
 /// Returns `None` if the map does not contain the key. If there are
@@ -156,6 +482,30 @@ pub unsafe extern "C" fn header_map_remove(handle: *mut HeaderMap, key: *const c
     true
 }
 
+/// Same as `header_map_remove` with a `key_len` byte key, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_remove_len(
+    handle: *mut HeaderMap,
+    key: *const u8,
+    key_len: usize,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return false;
+    }
+
+    match to_rust_str_span(key, key_len, "parse key error") {
+        Some(k) => {
+            (*handle).remove(k);
+            true
+        }
+        None => false,
+    }
+}
+
 ///Don't forget free
 #[no_mangle]
 pub unsafe extern "C" fn header_map_get(
@@ -197,6 +547,38 @@ pub unsafe extern "C" fn header_map_get(
     ret
 }
 
+/// Same as `header_map_get` with a `key_len` byte key, which needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_get_len(
+    handle: *mut HeaderMap,
+    key: *const u8,
+    key_len: usize,
+) -> *mut RString {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return ptr::null_mut();
+    }
+
+    let r_key = match to_rust_str_span(key, key_len, "parse key error") {
+        Some(v) => v,
+        None => {
+            return ptr::null_mut();
+        }
+    };
+
+    match (*handle).get(r_key).map(|v| v.to_str()) {
+        Some(Ok(v)) => Box::into_raw(Box::new(RString::new(v.to_string()))),
+        Some(Err(e)) => {
+            update_last_error(HttpErrorKind::CharConversion, Error::new(e));
+            ptr::null_mut()
+        }
+        None => ptr::null_mut(),
+    }
+}
+
 /// Returns the number of headers stored in the map.
 ///
 /// This number represents the total number of **values** stored in the map.
@@ -378,7 +760,30 @@ pub unsafe extern "C" fn header_map_contains_key(
     ret
 }
 
-//TODO get keys array-string
+/// Same as `header_map_contains_key` with a `key_len` byte key, which
+/// needs no NUL.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_contains_key_len(
+    handle: *mut HeaderMap,
+    key: *const u8,
+    key_len: usize,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle is null"),
+        );
+        return false;
+    }
+
+    match to_rust_str_span(key, key_len, "parse key error") {
+        Some(k) => (*handle).contains_key(k),
+        None => false,
+    }
+}
+
+/// Keys joined with `;`. Use `header_map_entries` to walk the map without
+/// re-parsing.
 #[no_mangle]
 pub unsafe extern "C" fn header_map_keys(handle: *mut HeaderMap) -> *mut RString {
     if handle.is_null() {
@@ -406,7 +811,8 @@ pub unsafe extern "C" fn header_map_keys(handle: *mut HeaderMap) -> *mut RString
     Box::into_raw(Box::new(RString::new(keys)))
 }
 
-//TODO get values array-string
+/// Values in Debug format, with non-visible ones as "opaque". Use
+/// `header_map_entries` to get the exact bytes.
 #[no_mangle]
 pub unsafe extern "C" fn header_map_values(handle: *mut HeaderMap) -> *mut RString {
     if handle.is_null() {
@@ -430,6 +836,83 @@ pub unsafe extern "C" fn header_map_values(handle: *mut HeaderMap) -> *mut RStri
     Box::into_raw(Box::new(RString::new(ret)))
 }
 
+unsafe fn entries_with<F>(
+    handle: *mut HeaderMap,
+    count: *mut usize,
+    what: &str,
+    alloc: F,
+) -> *mut HeaderSpan
+where
+    F: FnOnce(usize, usize) -> Option<*mut u8>,
+{
+    if handle.is_null() || count.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("header_map handle or count is null when use {}", what),
+        );
+        return ptr::null_mut();
+    }
+
+    let header_map = &*handle;
+    match write_headers(header_map, alloc) {
+        Some(v) => {
+            *count = header_map.len();
+            v
+        }
+        None => {
+            update_last_error(
+                HttpErrorKind::OutOfMemory,
+                anyhow!("no memory for the {} block", what),
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+/// Every entry of the map as a (name, value bytes) span, in one block: the
+/// `count` spans followed by the bytes they point to. A key with several
+/// values appears once per value, and values are exact, not made visible.
+///
+/// The block is a copy, unaffected by later changes to the map. Release it
+/// with `free_header_spans`. Returns null on failure.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_entries(
+    handle: *mut HeaderMap,
+    count: *mut usize,
+) -> *mut HeaderSpan {
+    entries_with(handle, count, "entries", |size, align| {
+        alloc_owned(size, align)
+    })
+}
+
+/// Same as `header_map_entries`, in memory from `allocator`, which owns it.
+#[no_mangle]
+pub unsafe extern "C" fn header_map_entries_into(
+    handle: *mut HeaderMap,
+    allocator: *const Allocator,
+    count: *mut usize,
+) -> *mut HeaderSpan {
+    if allocator.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("allocator is null when use entries_into"),
+        );
+        return ptr::null_mut();
+    }
+
+    entries_with(handle, count, "entries_into", |size, align| {
+        (*allocator).allocate(size, align)
+    })
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn free_header_spans(spans: *mut HeaderSpan) {
+    if spans.is_null() {
+        return;
+    }
+    free_owned(spans as *mut u8);
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn header_map_destroy(handle: *mut HeaderMap) {
     if handle.is_null() {
@@ -437,3 +920,97 @@ pub unsafe extern "C" fn header_map_destroy(handle: *mut HeaderMap) {
     }
     drop(Box::from_raw(handle));
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn pair(key: &'static [u8], value: &'static [u8]) -> Pair {
+        Pair {
+            key: key.as_ptr() as *const c_char,
+            value: value.as_ptr() as *const c_char,
+        }
+    }
+
+    #[test]
+    fn insert_many_replaces_and_keeps_repeats() {
+        let pairs = [
+            pair(b"x-a\0", b"1\0"),
+            pair(b"x-b\0", b"2\0"),
+            pair(b"x-a\0", b"3\0"),
+        ];
+        let mut map = HeaderMap::new();
+        map.insert("x-a", "old".parse().unwrap());
+        map.insert("x-c", "kept".parse().unwrap());
+
+        assert!(unsafe { header_map_insert_many(&mut map, pairs.as_ptr(), pairs.len()) });
+        let all: Vec<_> = map.get_all("x-a").iter().collect();
+        assert_eq!(all, ["1", "3"]);
+        assert_eq!(map["x-b"], "2");
+        assert_eq!(map["x-c"], "kept");
+
+        let bad = [pair(b"x-d\0", b"4\0"), pair(b"bad name\0", b"v\0")];
+        assert!(!unsafe { header_map_insert_many(&mut map, bad.as_ptr(), 2) });
+        assert_eq!(map.len(), 4);
+    }
+
+    #[test]
+    fn len_variants_read_exactly_len_bytes() {
+        let mut map = HeaderMap::new();
+        let text = b"x-keyTRAILING value-1NOPE";
+        unsafe {
+            assert!(header_map_insert_len(
+                &mut map,
+                text.as_ptr(),
+                5,
+                text.as_ptr().add(14),
+                7
+            ));
+            assert!(header_map_contains_key_len(&mut map, text.as_ptr(), 5));
+            assert!(!header_map_insert_len(
+                &mut map,
+                b"x-nul".as_ptr(),
+                5,
+                b"a\0b".as_ptr(),
+                3
+            ));
+        }
+        assert_eq!(map["x-key"], "value-1");
+        assert_eq!(map.len(), 1);
+    }
+
+    #[test]
+    #[ignore]
+    fn bench_interned_header() {
+        use std::time::Instant;
+
+        const ROUNDS: usize = 1_000_000;
+        let key = b"x-request-id\0".as_ptr() as *const c_char;
+        let value = b"0af7651916cd43dd8448eb211c80319c\0";
+        let mut map = HeaderMap::with_capacity(1);
+
+        let start = Instant::now();
+        for _ in 0..ROUNDS {
+            unsafe { header_map_insert(&mut map, key, value.as_ptr() as *const c_char) };
+        }
+        let parsed = start.elapsed();
+
+        let name = unsafe { header_name_new(key) };
+        let interned = unsafe { header_value_from_static(value.as_ptr(), value.len() - 1) };
+        let start = Instant::now();
+        for _ in 0..ROUNDS {
+            unsafe { header_map_insert_interned(&mut map, name, interned) };
+        }
+        let cloned = start.elapsed();
+
+        println!(
+            "parsed {:.0} ns/header, interned {:.0} ns/header",
+            parsed.as_nanos() as f64 / ROUNDS as f64,
+            cloned.as_nanos() as f64 / ROUNDS as f64
+        );
+        unsafe {
+            header_name_destroy(name);
+            header_value_destroy(interned);
+        }
+    }
+}
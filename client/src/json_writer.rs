@@ -0,0 +1,727 @@
+//! JSON written value by value straight into a request body, either
+//! buffered whole or streamed out in chunks while the request is sent.
+
+use crate::ffi::*;
+use anyhow::{anyhow, Error};
+use futures_util::FutureExt;
+use http_err::HttpErrorKind;
+use request_builder::{BODY_STREAM_CHUNK, BODY_STREAM_DEPTH};
+use reqwest::header::{HeaderValue, CONTENT_TYPE};
+use reqwest::{Body, RequestBuilder};
+use response;
+use runtime;
+use std::io::{self, Write};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::task::Poll;
+use std::{mem, ptr, str};
+use tokio::sync::{mpsc, oneshot};
+use utils::{self, extract_file_name};
+
+/// Where the chunks of a streamed document go.
+struct Upload {
+    tx: mpsc::Sender<io::Result<bytes::Bytes>>,
+    /// Set once the document is complete; the body fails instead of ending
+    /// if the writer goes away before that, so nothing truncated is sent.
+    complete: Arc<AtomicBool>,
+    response: oneshot::Receiver<reqwest::Result<reqwest::Response>>,
+}
+
+pub struct JsonWriter {
+    buf: Vec<u8>,
+    /// Open containers, innermost last: `b'{'` or `b'['`.
+    stack: Vec<u8>,
+    /// Something was written at this level, so a comma goes before the next.
+    separate: bool,
+    /// Inside an object, a key was written and its value comes next.
+    after_key: bool,
+    /// The top-level value is finished.
+    done: bool,
+    failed: bool,
+    upload: Option<Upload>,
+}
+
+impl JsonWriter {
+    fn new(upload: Option<Upload>) -> Self {
+        let capacity = if upload.is_some() {
+            BODY_STREAM_CHUNK
+        } else {
+            0
+        };
+        JsonWriter {
+            buf: Vec::with_capacity(capacity),
+            stack: Vec::new(),
+            separate: false,
+            after_key: false,
+            done: false,
+            failed: false,
+            upload,
+        }
+    }
+
+    /// Fail the writer for good: every later call fails too.
+    fn fail(&mut self, err: Error) -> bool {
+        self.failed = true;
+        update_last_error(HttpErrorKind::InvalidInput, err);
+        false
+    }
+
+    fn usable(&mut self) -> bool {
+        if self.failed {
+            update_last_error(
+                HttpErrorKind::InvalidInput,
+                anyhow!("json writer failed earlier"),
+            );
+            return false;
+        }
+        true
+    }
+
+    /// Check a value may go here and write the comma before it.
+    fn begin_value(&mut self) -> bool {
+        if !self.usable() {
+            return false;
+        }
+        if self.done {
+            return self.fail(anyhow!("json document is already complete"));
+        }
+        match self.stack.last() {
+            Some(&b'{') if !self.after_key => {
+                return self.fail(anyhow!("json object value without a key"));
+            }
+            Some(&b'{') => self.after_key = false,
+            Some(_) if self.separate => self.buf.push(b','),
+            _ => {}
+        }
+        true
+    }
+
+    fn end_value(&mut self) -> bool {
+        self.separate = true;
+        self.done = self.stack.is_empty();
+        if self.upload.is_some() && self.buf.len() >= BODY_STREAM_CHUNK {
+            return self.flush();
+        }
+        true
+    }
+
+    fn open(&mut self, bracket: u8) -> bool {
+        if !self.begin_value() {
+            return false;
+        }
+        self.buf.push(bracket);
+        self.stack.push(bracket);
+        self.separate = false;
+        true
+    }
+
+    fn close(&mut self, open: u8, close: u8) -> bool {
+        if !self.usable() {
+            return false;
+        }
+        if self.stack.last() != Some(&open) || self.after_key {
+            let what = if open == b'{' { "object" } else { "array" };
+            return self.fail(anyhow!("no json {} to end here", what));
+        }
+        self.stack.pop();
+        self.buf.push(close);
+        self.end_value()
+    }
+
+    fn key(&mut self, key: &[u8]) -> bool {
+        if !self.usable() {
+            return false;
+        }
+        if self.stack.last() != Some(&b'{') || self.after_key {
+            return self.fail(anyhow!("json key outside an object or missing its value"));
+        }
+        let key = match str::from_utf8(key) {
+            Ok(v) => v,
+            Err(e) => return self.fail(Error::new(e).context("json key is not UTF-8")),
+        };
+        if self.separate {
+            self.buf.push(b',');
+        }
+        escape(&mut self.buf, key);
+        self.buf.push(b':');
+        self.after_key = true;
+        true
+    }
+
+    fn string(&mut self, value: &[u8]) -> bool {
+        let value = match str::from_utf8(value) {
+            Ok(v) => v,
+            Err(e) => return self.fail(Error::new(e).context("json string is not UTF-8")),
+        };
+        if !self.begin_value() {
+            return false;
+        }
+        escape(&mut self.buf, value);
+        self.end_value()
+    }
+
+    /// `value` already formatted as JSON, written as is.
+    fn raw(&mut self, value: &[u8]) -> bool {
+        if !self.begin_value() {
+            return false;
+        }
+        self.buf.extend_from_slice(value);
+        self.end_value()
+    }
+
+    fn double(&mut self, value: f64) -> bool {
+        if !value.is_finite() {
+            return self.fail(anyhow!("{} has no json representation", value));
+        }
+        if !self.begin_value() {
+            return false;
+        }
+        // Debug prints the shortest form that reads back exactly, with an
+        // exponent for very large or small values.
+        let _ = write!(self.buf, "{:?}", value);
+        self.end_value()
+    }
+
+    fn integer(&mut self, value: i64) -> bool {
+        if !self.begin_value() {
+            return false;
+        }
+        let _ = write!(self.buf, "{}", value);
+        self.end_value()
+    }
+
+    fn complete(&mut self) -> bool {
+        if self.failed || !self.done {
+            update_last_error(
+                HttpErrorKind::InvalidInput,
+                anyhow!("json document is incomplete"),
+            );
+            return false;
+        }
+        true
+    }
+
+    /// Hand what is buffered to the connection, waiting while earlier chunks
+    /// are still queued.
+    fn flush(&mut self) -> bool {
+        if self.buf.is_empty() {
+            return true;
+        }
+        let chunk = mem::replace(&mut self.buf, Vec::with_capacity(BODY_STREAM_CHUNK));
+        let sent = match self.upload {
+            Some(ref upload) => runtime::block_on(|| upload.tx.send(Ok(chunk.into()))).is_ok(),
+            None => true,
+        };
+        if !sent {
+            return self.fail(anyhow!("the request stopped reading the json body"));
+        }
+        true
+    }
+}
+
+/// `value` as a quoted JSON string.
+fn escape(buf: &mut Vec<u8>, value: &str) {
+    const HEX: &[u8; 16] = b"0123456789abcdef";
+
+    buf.push(b'"');
+    let bytes = value.as_bytes();
+    let mut start = 0;
+    for (i, &b) in bytes.iter().enumerate() {
+        let short = match b {
+            b'"' => b'"',
+            b'\\' => b'\\',
+            b'\n' => b'n',
+            b'\r' => b'r',
+            b'\t' => b't',
+            0x08 => b'b',
+            0x0c => b'f',
+            0x00..=0x1f => b'u',
+            _ => continue,
+        };
+        buf.extend_from_slice(&bytes[start..i]);
+        buf.push(b'\\');
+        buf.push(short);
+        if short == b'u' {
+            buf.extend_from_slice(&[b'0', b'0', HEX[(b >> 4) as usize], HEX[(b & 0xf) as usize]]);
+        }
+        start = i + 1;
+    }
+    buf.extend_from_slice(&bytes[start..]);
+    buf.push(b'"');
+}
+
+unsafe fn with_writer<F>(handle: *mut JsonWriter, what: &str, f: F) -> bool
+where
+    F: FnOnce(&mut JsonWriter) -> bool,
+{
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("json_writer is null when use {}", what),
+        );
+        return false;
+    }
+    f(&mut *handle)
+}
+
+/// A writer that keeps the whole document, for `request_builder_json_writer`.
+///
+/// Every call appends in place and returns `false` on misuse (a value in an
+/// object without a key, an unbalanced end, a second top-level value). The
+/// writer then stays failed.
+#[no_mangle]
+pub extern "C" fn json_writer_new() -> *mut JsonWriter {
+    Box::into_raw(Box::new(JsonWriter::new(None)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_begin_object(handle: *mut JsonWriter) -> bool {
+    with_writer(handle, "begin_object", |w| w.open(b'{'))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_end_object(handle: *mut JsonWriter) -> bool {
+    with_writer(handle, "end_object", |w| w.close(b'{', b'}'))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_begin_array(handle: *mut JsonWriter) -> bool {
+    with_writer(handle, "begin_array", |w| w.open(b'['))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_end_array(handle: *mut JsonWriter) -> bool {
+    with_writer(handle, "end_array", |w| w.close(b'[', b']'))
+}
+
+/// The key of the next object member; `len` UTF-8 bytes, escaped here.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_key(
+    handle: *mut JsonWriter,
+    key: *const u8,
+    len: usize,
+) -> bool {
+    with_writer(handle, "key", |w| w.key(to_rust_bytes(key, len)))
+}
+
+/// A string of `len` UTF-8 bytes, escaped here.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_string(
+    handle: *mut JsonWriter,
+    value: *const u8,
+    len: usize,
+) -> bool {
+    with_writer(handle, "string", |w| w.string(to_rust_bytes(value, len)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_integer(handle: *mut JsonWriter, value: i64) -> bool {
+    with_writer(handle, "integer", |w| w.integer(value))
+}
+
+/// Fails for NaN and infinities, which JSON can't represent.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_double(handle: *mut JsonWriter, value: f64) -> bool {
+    with_writer(handle, "double", |w| w.double(value))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_bool(handle: *mut JsonWriter, value: bool) -> bool {
+    with_writer(handle, "bool", |w| {
+        w.raw(if value { b"true" } else { b"false" })
+    })
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_null(handle: *mut JsonWriter) -> bool {
+    with_writer(handle, "null", |w| w.raw(b"null"))
+}
+
+/// A value already serialized as JSON, copied in without being checked.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_raw(
+    handle: *mut JsonWriter,
+    value: *const u8,
+    len: usize,
+) -> bool {
+    with_writer(handle, "raw", |w| w.raw(to_rust_bytes(value, len)))
+}
+
+/// Releases a writer. A streamed document that wasn't finished aborts its
+/// request rather than sending a truncated body.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_destroy(handle: *mut JsonWriter) {
+    if handle.is_null() {
+        return;
+    }
+    drop(Box::from_raw(handle));
+}
+
+/// Use the complete document of `writer` as the body, with
+/// `Content-Type: application/json`. The bytes are moved, not copied.
+///
+/// `writer` is consumed, even on failure.
+#[no_mangle]
+pub unsafe extern "C" fn request_builder_json_writer(
+    handle: *mut RequestBuilder,
+    writer: *mut JsonWriter,
+) -> *mut RequestBuilder {
+    if handle.is_null() || writer.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("request_builder or json_writer is null when use json_writer"),
+        );
+        if !writer.is_null() {
+            json_writer_destroy(writer);
+        }
+        return ptr::null_mut();
+    }
+
+    let mut writer = Box::from_raw(writer);
+    if writer.upload.is_some() {
+        update_last_error(
+            HttpErrorKind::InvalidInput,
+            anyhow!("a streaming json_writer is sent with json_writer_finish"),
+        );
+        return ptr::null_mut();
+    }
+    if !writer.complete() {
+        return ptr::null_mut();
+    }
+
+    let body = mem::replace(&mut writer.buf, Vec::new());
+    update_in_place(handle, |b| {
+        b.header(CONTENT_TYPE, HeaderValue::from_static("application/json"))
+            .body(body)
+    })
+}
+
+/// Send the request now with a JSON body written through the returned
+/// writer while it is in flight. Chunks of about 64 KiB go out with chunked
+/// encoding as they fill, so a document of any size needs only a few of
+/// them in memory; writing blocks while the connection catches up.
+///
+/// Consumes the builder, replacing any body it had. Finish with
+/// `json_writer_finish` for the response. Must not be called on a runtime
+/// worker thread.
+#[no_mangle]
+pub unsafe extern "C" fn request_builder_json_stream(
+    handle: *mut RequestBuilder,
+) -> *mut JsonWriter {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("request_builder is null when use json_stream"),
+        );
+        return ptr::null_mut();
+    }
+
+    let (tx, mut rx) = mpsc::channel(BODY_STREAM_DEPTH);
+    let complete = Arc::new(AtomicBool::new(false));
+    let finished = complete.clone();
+    let mut ended = false;
+    let chunks = futures_util::stream::poll_fn(move |cx| {
+        if ended {
+            return Poll::Ready(None);
+        }
+        match rx.poll_recv(cx) {
+            Poll::Ready(None) if !finished.load(Ordering::Acquire) => {
+                ended = true;
+                Poll::Ready(Some(Err(io::Error::new(
+                    io::ErrorKind::Other,
+                    "json writer dropped before the document was complete",
+                ))))
+            }
+            other => other,
+        }
+    });
+
+    let builder = Box::from_raw(handle)
+        .header(CONTENT_TYPE, HeaderValue::from_static("application/json"))
+        .body(Body::wrap_stream(chunks));
+    let (done, response) = oneshot::channel();
+    runtime::spawn(move || {
+        builder.send().map(move |result| {
+            let _ = done.send(result);
+        })
+    });
+
+    let upload = Upload {
+        tx,
+        complete,
+        response,
+    };
+    Box::into_raw(Box::new(JsonWriter::new(Some(upload))))
+}
+
+/// End a document started with `request_builder_json_stream` and wait for
+/// the response. The writer is consumed.
+///
+/// Returns null if the request failed or the document is incomplete, in
+/// which case the upload was aborted.
+#[no_mangle]
+pub unsafe extern "C" fn json_writer_finish(handle: *mut JsonWriter) -> *mut response::Response {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("json_writer is null when use finish"),
+        );
+        return ptr::null_mut();
+    }
+
+    let mut writer = Box::from_raw(handle);
+    if writer.upload.is_none() {
+        update_last_error(
+            HttpErrorKind::InvalidInput,
+            anyhow!("json_writer isn't streaming, use request_builder_json_writer"),
+        );
+        return ptr::null_mut();
+    }
+
+    let complete = writer.complete() && writer.flush();
+    let Upload {
+        tx,
+        complete: finished,
+        response,
+    } = match writer.upload.take() {
+        Some(v) => v,
+        None => return ptr::null_mut(),
+    };
+    finished.store(complete, Ordering::Release);
+    drop(tx);
+
+    let result = runtime::block_on(|| response);
+    if !complete {
+        // Whatever the aborted request reported, the document is the cause.
+        update_last_error(
+            HttpErrorKind::InvalidInput,
+            anyhow!("json document is incomplete, upload aborted"),
+        );
+        return ptr::null_mut();
+    }
+
+    match result {
+        Ok(Ok(r)) => Box::into_raw(Box::new(response::Response::new(Some(r)))),
+        Ok(Err(e)) => {
+            let mut kind = HttpErrorKind::NoError;
+            utils::parse_err(&e, &mut kind);
+            update_last_error(
+                kind,
+                anyhow!("{}#{}:{}, {e}.", extract_file_name(file!()), line!(), e),
+            );
+            ptr::null_mut()
+        }
+        Err(_) => {
+            update_last_error(
+                HttpErrorKind::Other,
+                anyhow!("json upload ended without a response"),
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Read;
+    use std::net::TcpListener;
+    use std::time::Instant;
+
+    fn text(w: &JsonWriter) -> &str {
+        str::from_utf8(&w.buf).unwrap()
+    }
+
+    #[test]
+    fn writes_nested_values() {
+        let mut w = JsonWriter::new(None);
+        assert!(w.open(b'{'));
+        assert!(w.key(b"id") && w.integer(-7));
+        assert!(w.key(b"name") && w.string("a\"b\\c\n\u{1}é".as_bytes()));
+        assert!(w.key(b"tags") && w.open(b'['));
+        assert!(w.raw(b"true") && w.double(0.5) && w.double(1e300) && w.raw(b"null"));
+        assert!(w.open(b'{') && w.close(b'{', b'}'));
+        assert!(w.close(b'[', b']'));
+        assert!(w.close(b'{', b'}'));
+        assert!(w.complete());
+        assert_eq!(
+            text(&w),
+            r#"{"id":-7,"name":"a\"b\\c\n\u0001é","tags":[true,0.5,1e300,null,{}]}"#
+        );
+    }
+
+    #[test]
+    fn misuse_fails_for_good() {
+        let mut w = JsonWriter::new(None);
+        assert!(w.open(b'{'));
+        assert!(!w.integer(1), "value without a key");
+        assert!(!w.key(b"k"), "stays failed");
+
+        let mut w = JsonWriter::new(None);
+        assert!(w.open(b'['));
+        assert!(!w.close(b'{', b'}'));
+
+        let mut w = JsonWriter::new(None);
+        assert!(w.integer(1));
+        assert!(!w.integer(2), "second top-level value");
+
+        let mut w = JsonWriter::new(None);
+        assert!(!w.double(std::f64::NAN));
+        assert!(!JsonWriter::new(None).complete());
+    }
+
+    /// Server that counts the body bytes of each request, sized or chunked,
+    /// and answers with the count.
+    fn serve_counter() -> String {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+        std::thread::spawn(move || {
+            for stream in listener.incoming() {
+                let mut stream = stream.unwrap();
+                std::thread::spawn(move || {
+                    let mut buf = vec![0u8; 256 * 1024];
+                    let mut data = Vec::new();
+                    loop {
+                        // Headers first; a new request never overlaps the last.
+                        let head = loop {
+                            if let Some(i) = data.windows(4).position(|w| w == b"\r\n\r\n") {
+                                break i + 4;
+                            }
+                            let n = stream.read(&mut buf).unwrap_or(0);
+                            if n == 0 {
+                                return;
+                            }
+                            data.extend_from_slice(&buf[..n]);
+                        };
+                        let headers = String::from_utf8_lossy(&data[..head]).to_lowercase();
+                        let length = headers
+                            .lines()
+                            .find(|line| line.starts_with("content-length:"))
+                            .map(|line| line[15..].trim().parse::<usize>().unwrap());
+                        let mut total = data.len() - head;
+                        let mut tail = data.split_off(head);
+                        data.clear();
+                        loop {
+                            let end = match length {
+                                Some(length) => total >= length,
+                                None => tail.ends_with(b"0\r\n\r\n"),
+                            };
+                            if end {
+                                break;
+                            }
+                            let n = stream.read(&mut buf).unwrap_or(0);
+                            if n == 0 {
+                                return;
+                            }
+                            total += n;
+                            tail.extend_from_slice(&buf[..n]);
+                            let keep = tail.len().saturating_sub(5);
+                            tail.drain(..keep);
+                        }
+                        let reply = format!(
+                            "HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}",
+                            total.to_string().len(),
+                            total
+                        );
+                        if stream.write_all(reply.as_bytes()).is_err() {
+                            return;
+                        }
+                    }
+                });
+            }
+        });
+        format!("http://{}/ingest", addr)
+    }
+
+    /// Peak resident set in KiB since the last call.
+    fn take_peak_rss() -> u64 {
+        let status = std::fs::read_to_string("/proc/self/status").unwrap_or_default();
+        let peak = status
+            .lines()
+            .find(|line| line.starts_with("VmHWM:"))
+            .and_then(|line| line[6..].trim().trim_end_matches(" kB").parse().ok())
+            .unwrap_or(0);
+        let _ = std::fs::write("/proc/self/clear_refs", "5");
+        peak
+    }
+
+    /// Stream a 20 MB array of records and compare with building the whole
+    /// document in a string and sending that.
+    ///
+    /// cargo test --release bench_json_stream -- --ignored --nocapture
+    #[test]
+    #[ignore]
+    fn bench_json_stream() {
+        const RECORDS: i64 = 200_000;
+        let url = serve_counter();
+        let client = reqwest::Client::new();
+
+        for round in 0..2 {
+            take_peak_rss();
+            let before = take_peak_rss();
+            let started = Instant::now();
+            let mut doc = String::from("[");
+            for i in 0..RECORDS {
+                if i > 0 {
+                    doc.push(',');
+                }
+                doc.push_str(&format!(
+                    r#"{{"id":{},"name":"record {}","score":{:?},"ok":true,"tags":["a","b"]}}"#,
+                    i,
+                    i,
+                    i as f64 / 3.0
+                ));
+            }
+            doc.push(']');
+            let size = doc.len();
+            let resp = runtime::block_on(|| client.post(url.as_str()).body(doc).send()).unwrap();
+            assert!(resp.status().is_success());
+            let string_ms = started.elapsed().as_secs_f64() * 1e3;
+            let string_rss = take_peak_rss().saturating_sub(before);
+
+            take_peak_rss();
+            let before = take_peak_rss();
+            let started = Instant::now();
+            unsafe {
+                let builder = Box::into_raw(Box::new(client.post(url.as_str())));
+                let w = request_builder_json_stream(builder);
+                let w = &mut *w;
+                assert!(w.open(b'['));
+                for i in 0..RECORDS {
+                    w.open(b'{');
+                    w.key(b"id");
+                    w.integer(i);
+                    w.key(b"name");
+                    w.string(format!("record {}", i).as_bytes());
+                    w.key(b"score");
+                    w.double(i as f64 / 3.0);
+                    w.key(b"ok");
+                    w.raw(b"true");
+                    w.key(b"tags");
+                    w.open(b'[');
+                    w.string(b"a");
+                    w.string(b"b");
+                    w.close(b'[', b']');
+                    w.close(b'{', b'}');
+                }
+                assert!(w.close(b'[', b']'));
+                let resp = json_writer_finish(w);
+                assert!(!resp.is_null());
+                drop(Box::from_raw(resp));
+            }
+            let stream_ms = started.elapsed().as_secs_f64() * 1e3;
+            let stream_rss = take_peak_rss().saturating_sub(before);
+
+            if round > 0 {
+                println!(
+                    "{} MB: string {:.1} ms peak RSS +{} KiB, stream {:.1} ms peak RSS +{} KiB",
+                    size >> 20,
+                    string_ms,
+                    string_rss,
+                    stream_ms,
+                    stream_rss
+                );
+            }
+        }
+    }
+}
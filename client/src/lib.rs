@@ -4,17 +4,46 @@ extern crate libc;
 #[macro_use]
 extern crate log;
 extern crate anyhow;
+extern crate bytes;
+extern crate futures_util;
+#[cfg(feature = "mimalloc")]
+extern crate mimalloc;
 pub extern crate reqwest;
+extern crate serde;
+#[cfg(feature = "jemalloc")]
+extern crate tikv_jemallocator;
+extern crate tokio;
 
+#[cfg(all(feature = "mimalloc", feature = "jemalloc"))]
+compile_error!("features `mimalloc` and `jemalloc` are mutually exclusive");
+
+#[cfg(feature = "mimalloc")]
+#[global_allocator]
+static GLOBAL: mimalloc::MiMalloc = mimalloc::MiMalloc;
+
+#[cfg(feature = "jemalloc")]
+#[global_allocator]
+static GLOBAL: tikv_jemallocator::Jemalloc = tikv_jemallocator::Jemalloc;
+
+mod body_pool;
+mod caller_alloc;
 mod client;
+mod descriptor;
+mod download;
 pub mod ffi;
+mod file_io;
 mod headermap;
 mod http_err;
 mod http_exeception;
+mod json_writer;
+mod meta;
 mod proxy;
 mod request;
 mod request_builder;
+mod request_template;
 mod resp_body;
 mod response;
+mod ring;
+mod runtime;
 mod rust_string;
 mod utils;
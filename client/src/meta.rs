@@ -0,0 +1,330 @@
+//! Everything about a response except its body, laid out in one block so
+//! C and C++ can read it without further calls or allocations.
+
+use crate::ffi::*;
+use anyhow::anyhow;
+use caller_alloc::Allocator;
+use http_err::HttpErrorKind;
+use reqwest::header::HeaderMap;
+use reqwest::Version;
+use response::Response;
+use std::alloc::{self, Layout};
+use std::{mem, ptr};
+
+/// Bytes inside a block such as `ResponseMeta`; not NUL-terminated.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct ByteSpan {
+    pub data: *const u8,
+    pub len: usize,
+}
+
+#[repr(C)]
+pub struct HeaderSpan {
+    pub name: ByteSpan,
+    pub value: ByteSpan,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum HttpVersion {
+    Http09,
+    Http10,
+    Http11,
+    Http2,
+    Http3,
+    Unknown,
+}
+
+/// Status line, addresses and headers of a response in one block: this
+/// struct, then the header array, then the bytes the spans point to.
+#[repr(C)]
+pub struct ResponseMeta {
+    pub status: i32,
+    pub version: HttpVersion,
+    pub url: ByteSpan,
+    /// Empty when the connection didn't report one.
+    pub remote_addr: ByteSpan,
+    /// In received order; a repeated header appears once per value.
+    pub headers: *const HeaderSpan,
+    pub header_count: usize,
+}
+
+/// Room in front of a block from `alloc_owned` recording its size. Also the
+/// alignment of every block, which keeps the part after the prefix aligned.
+const OWNED_PREFIX: usize = 16;
+
+/// A block `free_owned` can release without being told its size. `align`
+/// may not exceed `OWNED_PREFIX`, which the structs handed out here don't.
+pub(crate) unsafe fn alloc_owned(size: usize, align: usize) -> Option<*mut u8> {
+    debug_assert!(align <= OWNED_PREFIX);
+    let layout = Layout::from_size_align(OWNED_PREFIX + size, OWNED_PREFIX).ok()?;
+    let base = alloc::alloc(layout);
+    if base.is_null() {
+        return None;
+    }
+    (base as *mut usize).write(size);
+    Some(base.add(OWNED_PREFIX))
+}
+
+pub(crate) unsafe fn free_owned(block: *mut u8) {
+    let base = block.sub(OWNED_PREFIX);
+    let size = (base as *const usize).read();
+    alloc::dealloc(
+        base,
+        Layout::from_size_align_unchecked(OWNED_PREFIX + size, OWNED_PREFIX),
+    );
+}
+
+fn version(v: Version) -> HttpVersion {
+    match v {
+        Version::HTTP_09 => HttpVersion::Http09,
+        Version::HTTP_10 => HttpVersion::Http10,
+        Version::HTTP_11 => HttpVersion::Http11,
+        Version::HTTP_2 => HttpVersion::Http2,
+        Version::HTTP_3 => HttpVersion::Http3,
+        _ => HttpVersion::Unknown,
+    }
+}
+
+/// Copy `data` to `*cursor` and advance it past the copy.
+unsafe fn put(cursor: &mut *mut u8, data: &[u8]) -> ByteSpan {
+    let start = *cursor;
+    ptr::copy_nonoverlapping(data.as_ptr(), start, data.len());
+    *cursor = start.add(data.len());
+    ByteSpan {
+        data: start,
+        len: data.len(),
+    }
+}
+
+/// Bytes the names and values of `headers` take.
+fn header_bytes(headers: &HeaderMap) -> usize {
+    headers
+        .iter()
+        .map(|(k, v)| k.as_str().len() + v.as_bytes().len())
+        .sum()
+}
+
+/// A span per header at `spans`, copying the bytes to `*cursor`.
+unsafe fn put_headers(spans: *mut HeaderSpan, cursor: &mut *mut u8, headers: &HeaderMap) {
+    for (i, (k, v)) in headers.iter().enumerate() {
+        spans.add(i).write(HeaderSpan {
+            name: put(cursor, k.as_str().as_bytes()),
+            value: put(cursor, v.as_bytes()),
+        });
+    }
+}
+
+/// Every header of `headers` in memory from `alloc(size, align)`: the span
+/// array followed by the bytes it points to.
+pub(crate) unsafe fn write_headers<F>(headers: &HeaderMap, alloc: F) -> Option<*mut HeaderSpan>
+where
+    F: FnOnce(usize, usize) -> Option<*mut u8>,
+{
+    let table = headers.len() * mem::size_of::<HeaderSpan>();
+    let base = alloc(
+        (table + header_bytes(headers)).max(1),
+        mem::align_of::<HeaderSpan>(),
+    )?;
+
+    let spans = base as *mut HeaderSpan;
+    let mut cursor = base.add(table);
+    put_headers(spans, &mut cursor, headers);
+    Some(spans)
+}
+
+/// Parts of a response that go into its `ResponseMeta`.
+struct Parts<'a> {
+    status: u16,
+    version: Version,
+    url: &'a str,
+    remote_addr: &'a str,
+    headers: &'a HeaderMap,
+}
+
+/// Lay `parts` out in memory from `alloc(size, align)`.
+unsafe fn write_meta<F>(parts: &Parts, alloc: F) -> Option<*mut ResponseMeta>
+where
+    F: FnOnce(usize, usize) -> Option<*mut u8>,
+{
+    let (url, remote_addr, headers) = (parts.url, parts.remote_addr, parts.headers);
+
+    let table = mem::size_of::<ResponseMeta>() + headers.len() * mem::size_of::<HeaderSpan>();
+    let text = url.len() + remote_addr.len() + header_bytes(headers);
+    let base = alloc(table + text, mem::align_of::<ResponseMeta>())?;
+
+    let meta = base as *mut ResponseMeta;
+    let spans = base.add(mem::size_of::<ResponseMeta>()) as *mut HeaderSpan;
+    let mut cursor = base.add(table);
+    put_headers(spans, &mut cursor, headers);
+    meta.write(ResponseMeta {
+        status: parts.status as i32,
+        version: version(parts.version),
+        url: put(&mut cursor, url.as_bytes()),
+        remote_addr: put(&mut cursor, remote_addr.as_bytes()),
+        headers: spans,
+        header_count: headers.len(),
+    });
+
+    Some(meta)
+}
+
+unsafe fn meta_with<F>(handle: *mut Response, what: &str, alloc: F) -> *mut ResponseMeta
+where
+    F: FnOnce(usize, usize) -> Option<*mut u8>,
+{
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle is null when use {}", what),
+        );
+        return ptr::null_mut();
+    }
+
+    let resp = &*handle;
+    let r = match resp.inner {
+        Some(ref r) => r,
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use {}", what),
+            );
+            return ptr::null_mut();
+        }
+    };
+
+    let remote_addr = r.remote_addr().map(|a| a.to_string()).unwrap_or_default();
+    let parts = Parts {
+        status: r.status().as_u16(),
+        version: r.version(),
+        url: r.url().as_str(),
+        remote_addr: &remote_addr,
+        headers: r.headers(),
+    };
+    match write_meta(&parts, alloc) {
+        Some(v) => v,
+        None => {
+            update_last_error(
+                HttpErrorKind::OutOfMemory,
+                anyhow!("no memory for the {} block", what),
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+/// Status, version, URL, remote address and headers in one block, taken
+/// with a single call. Release it with `free_response_meta`.
+///
+/// Must be called before the body is consumed. Returns null on failure.
+#[no_mangle]
+pub unsafe extern "C" fn response_meta(handle: *mut Response) -> *mut ResponseMeta {
+    meta_with(handle, "meta", |size, align| alloc_owned(size, align))
+}
+
+/// Same as `response_meta`, in memory from `allocator`, which owns it.
+#[no_mangle]
+pub unsafe extern "C" fn response_meta_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+) -> *mut ResponseMeta {
+    if allocator.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("allocator is null when use meta_into"),
+        );
+        return ptr::null_mut();
+    }
+
+    meta_with(handle, "meta_into", |size, align| {
+        (*allocator).allocate(size, align)
+    })
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn free_response_meta(meta: *mut ResponseMeta) {
+    if meta.is_null() {
+        return;
+    }
+
+    free_owned(meta as *mut u8);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use reqwest::header::HeaderValue;
+    use std::slice;
+
+    fn text(span: ByteSpan) -> &'static str {
+        unsafe { std::str::from_utf8(slice::from_raw_parts(span.data, span.len)).unwrap() }
+    }
+
+    #[test]
+    fn meta_is_one_block() {
+        let mut headers = HeaderMap::new();
+        headers.insert("content-type", "text/plain".parse().unwrap());
+        headers.append("x-multi", "a".parse().unwrap());
+        headers.append("x-multi", "b".parse().unwrap());
+        let parts = Parts {
+            status: 206,
+            version: Version::HTTP_11,
+            url: "http://example.com/x",
+            remote_addr: "127.0.0.1:80",
+            headers: &headers,
+        };
+
+        let mut size = 0;
+        let meta = unsafe {
+            write_meta(&parts, |n, align| {
+                size = n;
+                alloc_owned(n, align)
+            })
+        }
+        .unwrap();
+
+        let m = unsafe { &*meta };
+        assert_eq!((m.status, m.version), (206, HttpVersion::Http11));
+        assert_eq!(text(m.url), "http://example.com/x");
+        assert_eq!(text(m.remote_addr), "127.0.0.1:80");
+        let spans = unsafe { slice::from_raw_parts(m.headers, m.header_count) };
+        let got: Vec<_> = spans
+            .iter()
+            .map(|h| (text(h.name), text(h.value)))
+            .collect();
+        assert_eq!(
+            got,
+            [
+                ("content-type", "text/plain"),
+                ("x-multi", "a"),
+                ("x-multi", "b")
+            ]
+        );
+
+        // Every span points inside the block.
+        let (lo, hi) = (meta as usize, meta as usize + size);
+        for h in spans {
+            assert!(h.name.data as usize >= lo && h.value.data as usize + h.value.len <= hi);
+        }
+        unsafe { free_response_meta(meta) };
+    }
+
+    #[test]
+    fn header_spans_keep_exact_bytes() {
+        let mut headers = HeaderMap::new();
+        headers.append("x-bin", HeaderValue::from_bytes(b"\xff\xfe").unwrap());
+        headers.append("x-bin", "two".parse().unwrap());
+
+        let spans = unsafe { write_headers(&headers, |n, align| alloc_owned(n, align)) }.unwrap();
+        let got = unsafe { slice::from_raw_parts(spans, 2) };
+        let bytes = |s: ByteSpan| unsafe { slice::from_raw_parts(s.data, s.len) };
+        assert_eq!(text(got[0].name), "x-bin");
+        assert_eq!(bytes(got[0].value), b"\xff\xfe");
+        assert_eq!(text(got[1].value), "two");
+        unsafe { free_owned(spans as *mut u8) };
+
+        let empty = unsafe { write_headers(&HeaderMap::new(), |n, align| alloc_owned(n, align)) };
+        unsafe { free_owned(empty.unwrap() as *mut u8) };
+    }
+}
@@ -1,4 +1,4 @@
-use reqwest::blocking::Request;
+use reqwest::Request;
 
 #[no_mangle]
 pub unsafe extern "C" fn request_destroy(handle: *mut Request) {
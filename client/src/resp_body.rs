@@ -1,13 +1,16 @@
 use anyhow::anyhow;
+use bytes::Bytes;
 use ffi::update_last_error;
 use http_err::HttpErrorKind;
 
+/// A response body handed to C. Holds the `Bytes` received from the
+/// connection as is, so exposing it to C costs no copy.
 pub struct RespBody {
-    pub(crate) inner: Vec<u8>,
+    pub(crate) inner: Bytes,
 }
 
 impl RespBody {
-    pub fn new(data: Vec<u8>) -> Self {
+    pub fn new(data: Bytes) -> Self {
         Self { inner: data }
     }
 }
@@ -1,21 +1,380 @@
 use crate::ffi::*;
 use anyhow::anyhow;
+use body_pool;
+use bytes::{Buf, Bytes};
+use caller_alloc::Allocator;
+use file_io::{self, FileWriter, FsyncPolicy};
+use futures_util::future::{self, BoxFuture};
+use futures_util::{FutureExt, Stream, StreamExt, TryStreamExt};
 use http_err::HttpErrorKind;
-use libc::c_char;
-use reqwest::header::HeaderMap;
+use libc::{c_char, c_void, wchar_t};
+use reqwest::header::{HeaderMap, CONTENT_TYPE};
 use reqwest::Version;
 use resp_body::RespBody;
+use runtime;
 use rust_string::RString;
-use std::{mem, ptr};
+use std::path::Path;
+use std::task::Poll;
+use std::time::Instant;
+use std::{ptr, slice};
 use utils;
 
 pub struct Response {
-    pub(crate) inner: Option<reqwest::blocking::Response>,
+    pub(crate) inner: Option<reqwest::Response>,
+    /// Tail of the last body chunk not yet handed out by `response_read`.
+    pub(crate) pending: Bytes,
 }
 
 impl Response {
-    pub fn new(inner: Option<reqwest::blocking::Response>) -> Self {
-        Self { inner }
+    pub fn new(inner: Option<reqwest::Response>) -> Self {
+        Self {
+            inner,
+            pending: Bytes::new(),
+        }
+    }
+}
+
+/// Called on a runtime worker thread when `response_bytes_async` finishes.
+///
+/// `body` is null on failure; otherwise ownership passes to the callee, which
+/// must release it with `free_resp_body`.
+pub type BodyCallback = extern "C" fn(user_data: *mut c_void, body: *mut RespBody);
+
+/// Called on a runtime worker thread when `response_read_async` finishes,
+/// with the same `count` `response_read` would have returned.
+pub type ReadCallback = extern "C" fn(user_data: *mut c_void, count: i32);
+
+/// Receives body chunks from `response_stream_to`, on the calling thread.
+///
+/// `data` is only valid during the call. Return `false` to stop the
+/// transfer.
+pub type SinkCallback = extern "C" fn(user_data: *mut c_void, data: *const u8, len: usize) -> bool;
+
+/// Options for `response_save_to_file`. All zeroes is a sensible default.
+#[repr(C)]
+pub struct SaveOptions {
+    /// Reserve `Content-Length` bytes up front, when the length is known.
+    pub preallocate: bool,
+    /// Bypass the page cache with `O_DIRECT` where the filesystem allows it.
+    pub direct_io: bool,
+    /// Bytes per write, rounded up to 4 KiB; 0 means 1 MiB.
+    pub write_size: usize,
+    pub fsync: FsyncPolicy,
+}
+
+/// What `response_save_to_file` did, times in microseconds.
+#[repr(C)]
+#[derive(Default)]
+pub struct SaveStats {
+    pub bytes_written: u64,
+    /// From the call until the file was synced.
+    pub elapsed_us: u64,
+    /// Spent inside write calls.
+    pub write_us: u64,
+    /// Spent in fsync/fdatasync.
+    pub sync_us: u64,
+}
+
+enum SaveError {
+    Http(reqwest::Error),
+    Io(std::io::Error),
+}
+
+fn save_to_path(
+    resp: &mut Response,
+    path: &Path,
+    options: &SaveOptions,
+) -> Result<SaveStats, SaveError> {
+    let started = Instant::now();
+    let r = match resp.inner.take() {
+        Some(r) => r,
+        None => {
+            return Err(SaveError::Io(std::io::Error::new(
+                std::io::ErrorKind::InvalidData,
+                "response is null when use save_to_file",
+            )))
+        }
+    };
+
+    let (file, direct) = file_io::create(path, options.direct_io).map_err(SaveError::Io)?;
+    let mut preallocated = false;
+    if options.preallocate {
+        if let Some(len) = r.content_length() {
+            file_io::preallocate(&file, len).map_err(SaveError::Io)?;
+            preallocated = true;
+        }
+    }
+
+    let write_size = match options.write_size {
+        0 => file_io::DEFAULT_WRITE_SIZE,
+        v => v,
+    };
+    let mut writer = FileWriter::new(file, write_size, direct, preallocated);
+    writer
+        .write(&resp.pending.split_off(0))
+        .map_err(SaveError::Io)?;
+    runtime::block_on(|| {
+        r.bytes_stream()
+            .map_err(SaveError::Http)
+            .try_for_each(|chunk| future::ready(writer.write(&chunk).map_err(SaveError::Io)))
+    })?;
+
+    let stats = writer.finish(options.fsync).map_err(SaveError::Io)?;
+    Ok(SaveStats {
+        bytes_written: stats.bytes_written,
+        elapsed_us: started.elapsed().as_micros() as u64,
+        write_us: stats.write_time.as_micros() as u64,
+        sync_us: stats.sync_time.as_micros() as u64,
+    })
+}
+
+unsafe fn save_to_file(
+    handle: *mut Response,
+    path: &Path,
+    options: *const SaveOptions,
+    stats: *mut SaveStats,
+) -> bool {
+    let default_options = SaveOptions {
+        preallocate: false,
+        direct_io: false,
+        write_size: 0,
+        fsync: FsyncPolicy::None,
+    };
+    let options = if options.is_null() {
+        &default_options
+    } else {
+        &*options
+    };
+
+    let mut resp = Box::from_raw(handle);
+    let result = save_to_path(&mut resp, path, options);
+    Box::leak(resp);
+
+    match result {
+        Ok(v) => {
+            if !stats.is_null() {
+                *stats = v;
+            }
+            true
+        }
+        Err(SaveError::Http(e)) => {
+            let mut kind = HttpErrorKind::NoError;
+            utils::parse_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e));
+
+            false
+        }
+        Err(SaveError::Io(e)) => {
+            let mut kind = HttpErrorKind::Other;
+            utils::parse_io_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e).context("save_to_file failed"));
+
+            false
+        }
+    }
+}
+
+/// Write the body straight to the file at `path`, replacing it, without
+/// passing it through the caller. This consumes the body.
+///
+/// `options` may be null for defaults; `stats` may be null. Returns `false`
+/// on failure, which may leave a partial file behind.
+#[no_mangle]
+pub unsafe extern "C" fn response_save_to_file(
+    handle: *mut Response,
+    path: *const c_char,
+    options: *const SaveOptions,
+    stats: *mut SaveStats,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle is null when use save_to_file".to_string()),
+        );
+        return false;
+    }
+
+    let r_path = match to_rust_str(path, "parse save path error") {
+        Some(v) => v,
+        None => {
+            return false;
+        }
+    };
+
+    save_to_file(handle, Path::new(r_path), options, stats)
+}
+
+/// Same as `response_save_to_file`, with a wide-character path.
+#[cfg(target_os = "windows")]
+#[no_mangle]
+pub unsafe extern "C" fn response_save_to_file_wide(
+    handle: *mut Response,
+    path: *const wchar_t,
+    length: usize,
+    options: *const SaveOptions,
+    stats: *mut SaveStats,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle is null when use save_to_file".to_string()),
+        );
+        return false;
+    }
+
+    let r_path = match to_rust_str_wide(path, length) {
+        Some(v) => v,
+        None => {
+            return false;
+        }
+    };
+
+    save_to_file(handle, Path::new(&r_path), options, stats)
+}
+
+/// Raw pointer moved into a runtime task. The caller of the `_async` function
+/// guarantees it stays valid until the callback has run.
+struct SendPtr<T>(*mut T);
+
+unsafe impl<T> Send for SendPtr<T> {}
+
+/// Fetch chunks until `pending` holds data or the body is exhausted.
+fn fill_pending(resp: SendPtr<Response>) -> BoxFuture<'static, reqwest::Result<()>> {
+    let this = unsafe { &mut *resp.0 };
+    match this.inner {
+        Some(ref mut r) if this.pending.is_empty() => r
+            .chunk()
+            .then(move |result| match result {
+                Ok(Some(chunk)) => {
+                    unsafe { (*resp.0).pending = chunk };
+                    fill_pending(resp)
+                }
+                Ok(None) => future::ready(Ok(())).boxed(),
+                Err(e) => future::ready(Err(e)).boxed(),
+            })
+            .boxed(),
+        _ => future::ready(Ok(())).boxed(),
+    }
+}
+
+/// Bytes to reserve for the body of `r`. `Content-Length` is only trusted up
+/// to the largest pool class so a bogus header can't reserve gigabytes
+/// before anything arrives; larger bodies grow as they are read.
+fn body_hint(r: &reqwest::Response) -> usize {
+    r.content_length()
+        .map_or(0, |len| len.min(body_pool::MAX_CLASS_SIZE as u64) as usize)
+}
+
+/// Append `data` to a buffer from `body_pool::take`, growing it in powers
+/// of two so it still fits a size class when it goes back.
+fn append(buf: &mut Vec<u8>, data: &[u8]) {
+    let needed = buf.len() + data.len();
+    if needed > buf.capacity() {
+        let target = needed.checked_next_power_of_two().unwrap_or(needed);
+        buf.reserve_exact(target - buf.len());
+    }
+    buf.extend_from_slice(data);
+}
+
+/// Append the rest of the body to `buf`, one chunk at a time.
+fn read_to_end(r: &mut reqwest::Response, buf: &mut Vec<u8>) -> reqwest::Result<()> {
+    while let Some(chunk) = runtime::block_on(|| r.chunk())? {
+        append(buf, &chunk);
+    }
+    Ok(())
+}
+
+/// Collect the rest of the body after `head`. A body that arrives as a
+/// single chunk is passed on as is; anything else is gathered in a buffer
+/// from the body pool.
+fn collect_body(r: reqwest::Response, head: Bytes) -> BoxFuture<'static, reqwest::Result<Bytes>> {
+    let hint = body_hint(&r);
+    let mut stream = r.bytes_stream().boxed();
+    let mut first = Some(head).filter(|b| !b.is_empty());
+    let mut buf: Option<Vec<u8>> = None;
+
+    future::poll_fn(move |cx| loop {
+        match stream.as_mut().poll_next(cx) {
+            Poll::Pending => return Poll::Pending,
+            Poll::Ready(Some(Err(e))) => return Poll::Ready(Err(e)),
+            Poll::Ready(Some(Ok(chunk))) => match (buf.as_mut(), first.take()) {
+                (Some(b), _) => append(b, &chunk),
+                (None, None) => first = Some(chunk),
+                (None, Some(f)) => {
+                    let mut b = body_pool::take(hint.max(f.len() + chunk.len()));
+                    append(&mut b, &f);
+                    append(&mut b, &chunk);
+                    buf = Some(b);
+                }
+            },
+            Poll::Ready(None) => {
+                let body = match buf.take() {
+                    Some(b) => body_pool::into_bytes(b),
+                    None => first.take().unwrap_or_default(),
+                };
+                return Poll::Ready(Ok(body));
+            }
+        }
+    })
+    .boxed()
+}
+
+/// Whether `text()` would decode this body as UTF-8: no charset, or a UTF-8
+/// one, in `Content-Type`.
+fn utf8_charset(r: &reqwest::Response) -> bool {
+    let charset = r
+        .headers()
+        .get(CONTENT_TYPE)
+        .and_then(|v| v.to_str().ok())
+        .and_then(|v| {
+            v.split(';')
+                .skip(1)
+                .map(|p| p.trim())
+                .find(|p| p.len() > 8 && p[..8].eq_ignore_ascii_case("charset="))
+        });
+    match charset {
+        Some(p) => {
+            let name = p[8..].trim_matches('"');
+            name.eq_ignore_ascii_case("utf-8") || name.eq_ignore_ascii_case("utf8")
+        }
+        None => true,
+    }
+}
+
+/// Decode a UTF-8 body the way `text()` does, honouring a byte order mark,
+/// without copying it when it is valid UTF-8 already.
+fn utf8_text(body: Bytes) -> Bytes {
+    let utf16 = |le: bool| {
+        let units: Vec<u16> = body[2..]
+            .chunks_exact(2)
+            .map(|c| {
+                if le {
+                    u16::from_le_bytes([c[0], c[1]])
+                } else {
+                    u16::from_be_bytes([c[0], c[1]])
+                }
+            })
+            .collect();
+        Bytes::from(String::from_utf16_lossy(&units).into_bytes())
+    };
+
+    if body.starts_with(b"\xFF\xFE") {
+        return utf16(true);
+    }
+    if body.starts_with(b"\xFE\xFF") {
+        return utf16(false);
+    }
+    let body = if body.starts_with(b"\xEF\xBB\xBF") {
+        body.slice(3..)
+    } else {
+        body
+    };
+
+    match String::from_utf8_lossy(&body) {
+        std::borrow::Cow::Borrowed(_) => body,
+        std::borrow::Cow::Owned(text) => Bytes::from(text.into_bytes()),
     }
 }
 
@@ -48,9 +407,15 @@ pub unsafe extern "C" fn response_body_text(handle: *mut Response) -> *mut RespB
 
     let result = resp.inner.take();
     let ret = if let Some(r) = result {
-        match r.text() {
+        let pending = resp.pending.split_off(0);
+        let text = if utf8_charset(&r) {
+            runtime::block_on(|| collect_body(r, pending)).map(utf8_text)
+        } else {
+            runtime::block_on(|| r.text()).map(|v| v.into_bytes().into())
+        };
+        match text {
             Ok(v) => {
-                let buf = RespBody::new(v.into_bytes());
+                let buf = RespBody::new(v);
                 Box::into_raw(Box::new(buf))
             }
             Err(e) => {
@@ -110,11 +475,9 @@ pub unsafe extern "C" fn response_body_text_with_charset(
                 }
             };
 
-        match r.text_with_charset(r_default_encoding) {
+        match runtime::block_on(|| r.text_with_charset(r_default_encoding)) {
             Ok(v) => {
-                let buffer = RespBody {
-                    inner: v.into_bytes(),
-                };
+                let buffer = RespBody::new(v.into_bytes().into());
 
                 Box::into_raw(Box::new(buffer))
             }
@@ -156,10 +519,10 @@ pub unsafe extern "C" fn response_bytes(handle: *mut Response) -> *mut RespBody
 
     let mut resp = Box::from_raw(handle);
     let buf = if let Some(r) = resp.inner.take() {
-        match r.bytes() {
+        let pending = resp.pending.split_off(0);
+        match runtime::block_on(|| collect_body(r, pending)) {
             Ok(b) => {
-                let v = b.to_vec();
-                let buffer = RespBody::new(v);
+                let buffer = RespBody::new(b);
 
                 Box::into_raw(Box::new(buffer))
             }
@@ -185,6 +548,65 @@ pub unsafe extern "C" fn response_bytes(handle: *mut Response) -> *mut RespBody
     buf
 }
 
+/// Get the full response body without blocking the calling thread.
+///
+/// `callback` is invoked exactly once, on a runtime worker thread, with
+/// `user_data` and the body (or null on failure). Like `response_bytes` this
+/// consumes the body. Returns `false` if nothing was queued, in which case
+/// `callback` is never called.
+#[no_mangle]
+pub unsafe extern "C" fn response_bytes_async(
+    handle: *mut Response,
+    callback: BodyCallback,
+    user_data: *mut c_void,
+) -> bool {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle is null when use bytes_async".to_string()),
+        );
+        return false;
+    }
+
+    let mut resp = Box::from_raw(handle);
+    let inner = resp.inner.take();
+    let pending = resp.pending.split_off(0);
+    Box::leak(resp);
+
+    let r = match inner {
+        Some(r) => r,
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use bytes_async".to_string()),
+            );
+            return false;
+        }
+    };
+
+    let user_data = UserData(user_data);
+    runtime::spawn(move || {
+        collect_body(r, pending).map(move |result| {
+            let buf = match result {
+                Ok(b) => Box::into_raw(Box::new(RespBody::new(b))),
+                Err(e) => {
+                    let mut kind = HttpErrorKind::NoError;
+                    utils::parse_err(&e, &mut kind);
+
+                    update_last_error(kind, anyhow!(e));
+
+                    ptr::null_mut()
+                }
+            };
+
+            let UserData(user_data) = user_data;
+            callback(user_data, buf);
+        })
+    });
+
+    true
+}
+
 /// Get the `StatusCode` of this `Response`.
 #[no_mangle]
 pub unsafe extern "C" fn response_status(handle: *mut Response) -> i32 {
@@ -262,14 +684,7 @@ pub unsafe extern "C" fn response_version(handle: *mut Response) -> *mut RString
 
     let resp = Box::from_raw(handle);
     let ret = if let Some(r) = &resp.inner {
-        let res = match r.version() {
-            Version::HTTP_09 => "HTTP/0.9",
-            Version::HTTP_10 => "HTTP/1.0",
-            Version::HTTP_11 => "HTTP/1.1",
-            Version::HTTP_2 => "HTTP/2.0",
-            Version::HTTP_3 => "HTTP/3.0",
-            _ => "unreachable",
-        };
+        let res = version_str(r.version());
 
         Box::into_raw(Box::new(RString::new(res.to_string())))
     } else {
@@ -286,6 +701,17 @@ pub unsafe extern "C" fn response_version(handle: *mut Response) -> *mut RString
     ret
 }
 
+fn version_str(version: Version) -> &'static str {
+    match version {
+        Version::HTTP_09 => "HTTP/0.9",
+        Version::HTTP_10 => "HTTP/1.0",
+        Version::HTTP_11 => "HTTP/1.1",
+        Version::HTTP_2 => "HTTP/2.0",
+        Version::HTTP_3 => "HTTP/3.0",
+        _ => "unreachable",
+    }
+}
+
 /// Get the final `Url` of this `Response`.
 #[no_mangle]
 pub unsafe extern "C" fn response_url(handle: *mut Response) -> *mut RString {
@@ -395,6 +821,109 @@ pub unsafe extern "C" fn response_content_length(handle: *mut Response) -> u64 {
     ret
 }
 
+/// Deliver the body to `sink` chunk by chunk as it arrives, without holding
+/// more than one chunk in memory.
+///
+/// Chunks smaller than `chunk_hint` bytes are merged until they reach it, to
+/// save calls for bodies that arrive in small pieces; 0 hands over every
+/// chunk as received. This consumes the body.
+///
+/// Returns the number of bytes delivered, or -1 if the transfer failed or
+/// `sink` returned `false`.
+#[no_mangle]
+pub unsafe extern "C" fn response_stream_to(
+    handle: *mut Response,
+    sink: SinkCallback,
+    user_data: *mut c_void,
+    chunk_hint: usize,
+) -> i64 {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle is null when use stream_to".to_string()),
+        );
+        return -1;
+    }
+
+    let mut resp = Box::from_raw(handle);
+    let inner = resp.inner.take();
+    let pending = resp.pending.split_off(0);
+    Box::leak(resp);
+
+    let r = match inner {
+        Some(r) => r,
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use stream_to".to_string()),
+            );
+            return -1;
+        }
+    };
+
+    let mut total: i64 = 0;
+    let mut merged: Vec<u8> = Vec::new();
+    // `Err(None)` means the sink asked to stop.
+    let mut deliver = |chunk: &[u8]| -> Result<(), Option<reqwest::Error>> {
+        total += chunk.len() as i64;
+        if sink(user_data, chunk.as_ptr(), chunk.len()) {
+            Ok(())
+        } else {
+            Err(None)
+        }
+    };
+
+    let mut result = if pending.is_empty() {
+        Ok(())
+    } else {
+        deliver(&pending)
+    };
+
+    if result.is_ok() {
+        result = runtime::block_on(|| {
+            r.bytes_stream().map_err(Some).try_for_each(|chunk| {
+                let res = if chunk_hint == 0 || (merged.is_empty() && chunk.len() >= chunk_hint) {
+                    deliver(&chunk)
+                } else {
+                    merged.extend_from_slice(&chunk);
+                    if merged.len() >= chunk_hint {
+                        let res = deliver(&merged);
+                        merged.clear();
+                        res
+                    } else {
+                        Ok(())
+                    }
+                };
+                future::ready(res)
+            })
+        });
+    }
+
+    if result.is_ok() && !merged.is_empty() {
+        result = deliver(&merged);
+    }
+
+    match result {
+        Ok(()) => total,
+        Err(Some(e)) => {
+            let mut kind = HttpErrorKind::NoError;
+            utils::parse_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e));
+
+            -1
+        }
+        Err(None) => {
+            update_last_error(
+                HttpErrorKind::Interrupted,
+                anyhow!("stream_to aborted by sink".to_string()),
+            );
+
+            -1
+        }
+    }
+}
+
 /// Copy the response body into a writer.
 /// Don't forget free
 ///
@@ -416,10 +945,12 @@ pub unsafe extern "C" fn response_copy_to(handle: *mut Response) -> *mut RespBod
 
     let mut resp = Box::from_raw(handle);
     let ret = if let Some(ref mut r) = resp.inner {
-        let mut buf: Vec<u8> = vec![];
-        match r.copy_to(&mut buf) {
+        let hint = body_hint(r);
+        let mut buf = body_pool::take(hint.max(resp.pending.len()));
+        append(&mut buf, &resp.pending.split_off(0));
+        match read_to_end(r, &mut buf) {
             Ok(_) => {
-                let buffer = RespBody { inner: buf };
+                let buffer = RespBody::new(body_pool::into_bytes(buf));
                 Box::into_raw(Box::new(buffer))
             }
             Err(e) => {
@@ -444,9 +975,13 @@ pub unsafe extern "C" fn response_copy_to(handle: *mut Response) -> *mut RespBod
     ret
 }
 
+/// Read at most `buf_len` bytes of the body into `buf`.
+///
+/// Returns the number of bytes read, 0 once the body is exhausted and -1 on
+/// failure.
 #[no_mangle]
 pub unsafe extern "C" fn response_read(handle: *mut Response, buf: *mut u8, buf_len: u32) -> i32 {
-    if handle.is_null() {
+    if handle.is_null() || buf.is_null() {
         update_last_error(
             HttpErrorKind::HttpHandleNull,
             anyhow!("handle is null when use read".to_string()),
@@ -454,56 +989,324 @@ pub unsafe extern "C" fn response_read(handle: *mut Response, buf: *mut u8, buf_
         return -1;
     }
 
-    use std::io::Read;
-
     let mut resp = Box::from_raw(handle);
-    let ret = if let Some(r) = &mut resp.inner {
-        let mut vec_buf = Vec::from_raw_parts(buf, buf_len as usize, buf_len as usize);
-        let result = r.read(&mut vec_buf[..]);
+    let ret = if let Some(ref mut r) = resp.inner {
+        let mut failed = false;
+        while resp.pending.is_empty() {
+            match runtime::block_on(|| r.chunk()) {
+                Ok(Some(chunk)) => resp.pending = chunk,
+                Ok(None) => break,
+                Err(e) => {
+                    let mut kind = HttpErrorKind::NoError;
+                    utils::parse_err(&e, &mut kind);
+
+                    update_last_error(kind, anyhow!(e));
+                    failed = true;
+                    break;
+                }
+            }
+        }
 
-        mem::forget(vec_buf);
+        if failed {
+            -1
+        } else {
+            let count = std::cmp::min(resp.pending.len(), buf_len as usize);
+            resp.pending
+                .copy_to_slice(slice::from_raw_parts_mut(buf, count));
 
-        let bytes_read = match result {
-            Ok(count) => count as i32,
-            Err(e) => {
-                let mut kind = HttpErrorKind::NoError;
-                utils::parse_io_err(&e, &mut kind);
+            count as i32
+        }
+    } else {
+        update_last_error(
+            HttpErrorKind::InvalidData,
+            anyhow!("response is null when use read".to_string()),
+        );
 
-                update_last_error(kind, anyhow!(e.to_string()));
+        -1
+    };
 
-                if let Some(ref inner_err) = e.into_inner() {
-                    if let Some(err) = inner_err.downcast_ref::<reqwest::Error>() {
-                        let mut kind = HttpErrorKind::NoError;
-                        utils::parse_err(&err, &mut kind);
+    Box::leak(resp);
 
-                        update_last_error(kind, anyhow!(err.to_string()));
-                    } else if let Some(err) = inner_err.downcast_ref::<std::io::Error>() {
-                        let mut kind = HttpErrorKind::NoError;
-                        utils::parse_io_err(&err, &mut kind);
+    ret
+}
 
-                        update_last_error(kind, anyhow!(err.to_string()));
-                    } else {
-                        update_last_error(HttpErrorKind::Other, anyhow!(inner_err.to_string()));
-                    }
+/// Read at most `buf_len` bytes of the body into `buf` without blocking the
+/// calling thread.
+///
+/// `callback` is invoked exactly once, on a runtime worker thread, with
+/// `user_data` and the count `response_read` would have returned. `handle`
+/// and `buf` must stay valid and untouched until then. Returns `false` if
+/// nothing was queued, in which case `callback` is never called.
+#[no_mangle]
+pub unsafe extern "C" fn response_read_async(
+    handle: *mut Response,
+    buf: *mut u8,
+    buf_len: u32,
+    callback: ReadCallback,
+    user_data: *mut c_void,
+) -> bool {
+    if handle.is_null() || buf.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("handle is null when use read_async".to_string()),
+        );
+        return false;
+    }
+
+    if (*handle).inner.is_none() {
+        update_last_error(
+            HttpErrorKind::InvalidData,
+            anyhow!("response is null when use read_async".to_string()),
+        );
+        return false;
+    }
+
+    let resp = SendPtr(handle);
+    let out = SendPtr(buf);
+    let user_data = UserData(user_data);
+    runtime::spawn(move || {
+        fill_pending(SendPtr(handle)).map(move |result| {
+            let count = match result {
+                Ok(()) => {
+                    let resp = &mut *resp.0;
+                    let count = std::cmp::min(resp.pending.len(), buf_len as usize);
+                    resp.pending
+                        .copy_to_slice(slice::from_raw_parts_mut(out.0, count));
+
+                    count as i32
                 }
+                Err(e) => {
+                    let mut kind = HttpErrorKind::NoError;
+                    utils::parse_err(&e, &mut kind);
 
-                -1
-            }
-        };
+                    update_last_error(kind, anyhow!(e));
+
+                    -1
+                }
+            };
+
+            let UserData(user_data) = user_data;
+            callback(user_data, count);
+        })
+    });
+
+    true
+}
+
+unsafe fn body_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+    len: *mut usize,
+    text: bool,
+) -> *mut u8 {
+    if handle.is_null() || allocator.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle or allocator is null when use body_into"),
+        );
+        return ptr::null_mut();
+    }
+
+    let mut resp = Box::from_raw(handle);
+    let inner = resp.inner.take();
+    let pending = resp.pending.split_off(0);
+    Box::leak(resp);
 
-        bytes_read
+    let r = match inner {
+        Some(r) => r,
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use body_into"),
+            );
+            return ptr::null_mut();
+        }
+    };
+
+    let body = if !text {
+        runtime::block_on(|| collect_body(r, pending))
+    } else if utf8_charset(&r) {
+        runtime::block_on(|| collect_body(r, pending)).map(utf8_text)
     } else {
+        runtime::block_on(|| r.text()).map(|v| v.into_bytes().into())
+    };
+
+    let body = match body {
+        Ok(v) => v,
+        Err(e) => {
+            let mut kind = HttpErrorKind::NoError;
+            utils::parse_err(&e, &mut kind);
+
+            update_last_error(kind, anyhow!(e));
+
+            return ptr::null_mut();
+        }
+    };
+
+    match (*allocator).copy_str(&body) {
+        Some(p) => {
+            if !len.is_null() {
+                *len = body.len();
+            }
+            p
+        }
+        None => {
+            update_last_error(
+                HttpErrorKind::OutOfMemory,
+                anyhow!("allocator failed to provide {} bytes", body.len() + 1),
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+/// Read the whole body into memory from `allocator`, followed by a NUL that
+/// `len` doesn't count. This consumes the body.
+///
+/// The memory belongs to the allocator; nothing has to be freed through this
+/// library. Returns null on failure.
+#[no_mangle]
+pub unsafe extern "C" fn response_bytes_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+    len: *mut usize,
+) -> *mut u8 {
+    body_into(handle, allocator, len, false)
+}
+
+/// Same as `response_bytes_into`, decoded like `response_body_text`.
+#[no_mangle]
+pub unsafe extern "C" fn response_text_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+    len: *mut usize,
+) -> *mut c_char {
+    body_into(handle, allocator, len, true) as *mut c_char
+}
+
+/// Copy every header into one block from `allocator`: `count` `Pair`s of
+/// NUL-terminated names and values, followed by the strings themselves.
+/// Returns null on failure.
+#[no_mangle]
+pub unsafe extern "C" fn response_headers_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+    count: *mut usize,
+) -> *mut Pair {
+    if handle.is_null() || allocator.is_null() {
         update_last_error(
-            HttpErrorKind::InvalidData,
-            anyhow!("response is null when use read".to_string()),
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle or allocator is null when use headers_into"),
         );
+        return ptr::null_mut();
+    }
 
-        -1
+    let resp = &*handle;
+    let r = match resp.inner {
+        Some(ref r) => r,
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use headers_into"),
+            );
+            return ptr::null_mut();
+        }
     };
 
-    Box::leak(resp);
+    match (*allocator).copy_headers(r.headers()) {
+        Some((pairs, n)) => {
+            if !count.is_null() {
+                *count = n;
+            }
+            pairs
+        }
+        None => {
+            update_last_error(
+                HttpErrorKind::OutOfMemory,
+                anyhow!("allocator failed to provide the header block"),
+            );
+            ptr::null_mut()
+        }
+    }
+}
 
-    ret
+unsafe fn string_into<F>(
+    handle: *mut Response,
+    allocator: *const Allocator,
+    what: &str,
+    get: F,
+) -> *mut c_char
+where
+    F: FnOnce(&reqwest::Response) -> Option<String>,
+{
+    if handle.is_null() || allocator.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("response handle or allocator is null when use {}", what),
+        );
+        return ptr::null_mut();
+    }
+
+    let resp = &*handle;
+    let value = match resp.inner.as_ref().map(get) {
+        Some(Some(v)) => v,
+        Some(None) => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response {} is empty", what),
+            );
+            return ptr::null_mut();
+        }
+        None => {
+            update_last_error(
+                HttpErrorKind::InvalidData,
+                anyhow!("response is null when use {}", what),
+            );
+            return ptr::null_mut();
+        }
+    };
+
+    match (*allocator).copy_str(value.as_bytes()) {
+        Some(p) => p as *mut c_char,
+        None => {
+            update_last_error(
+                HttpErrorKind::OutOfMemory,
+                anyhow!("allocator failed to provide {} bytes", value.len() + 1),
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+/// `response_url` as a NUL-terminated string from `allocator`.
+#[no_mangle]
+pub unsafe extern "C" fn response_url_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+) -> *mut c_char {
+    string_into(handle, allocator, "url_into", |r| Some(r.url().to_string()))
+}
+
+/// `response_version` as a NUL-terminated string from `allocator`.
+#[no_mangle]
+pub unsafe extern "C" fn response_version_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+) -> *mut c_char {
+    string_into(handle, allocator, "version_into", |r| {
+        Some(version_str(r.version()).to_string())
+    })
+}
+
+/// `response_remote_addr` as a NUL-terminated string from `allocator`.
+#[no_mangle]
+pub unsafe extern "C" fn response_remote_addr_into(
+    handle: *mut Response,
+    allocator: *const Allocator,
+) -> *mut c_char {
+    string_into(handle, allocator, "remote_addr_into", |r| {
+        r.remote_addr().map(|a| a.to_string())
+    })
 }
 
 #[no_mangle]
@@ -513,3 +1316,42 @@ pub unsafe extern "C" fn response_destroy(handle: *mut Response) {
     }
     drop(Box::from_raw(handle))
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::{Read, Write};
+    use std::net::TcpListener;
+
+    /// Answers one request claiming a terabyte of body, sends three bytes in
+    /// two writes and hangs up.
+    fn serve_lying_length() -> String {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+        std::thread::spawn(move || {
+            let (mut stream, _) = listener.accept().unwrap();
+            let mut buf = [0u8; 4096];
+            let _ = stream.read(&mut buf);
+            let _ = stream.write_all(b"HTTP/1.1 200 OK\r\nContent-Length: 1099511627776\r\n\r\na");
+            std::thread::sleep(std::time::Duration::from_millis(50));
+            let _ = stream.write_all(b"bc");
+        });
+        format!("http://{}/", addr)
+    }
+
+    #[test]
+    fn huge_content_length_does_not_reserve_it() {
+        let url = serve_lying_length();
+        let client = reqwest::Client::new();
+        let r = runtime::block_on(|| client.get(url.as_str()).send()).unwrap();
+        assert_eq!(body_hint(&r), body_pool::MAX_CLASS_SIZE);
+
+        // The body ends short of its length, which is an error rather than
+        // an abort on a terabyte allocation.
+        let handle = Box::into_raw(Box::new(Response::new(Some(r))));
+        unsafe {
+            assert!(response_copy_to(handle).is_null());
+            response_destroy(handle);
+        }
+    }
+}
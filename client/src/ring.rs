@@ -0,0 +1,655 @@
+//! Submission/completion queue pair modelled on io_uring.
+//!
+//! The caller pushes requests into the submission queue, hands the whole
+//! batch to the runtime with one `ring_submit` call and later reaps finished
+//! responses from the completion queue in bulk. On Linux the completion queue
+//! is signalled through an eventfd, so it can sit in an epoll loop next to
+//! the caller's other descriptors.
+
+use crate::ffi::*;
+use anyhow::anyhow;
+use futures_util::FutureExt;
+use http_err::HttpErrorKind;
+use reqwest::{Client, Request};
+use response;
+use runtime;
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::{ptr, slice};
+use utils;
+
+/// Keeps the producer and consumer indices on separate cache lines.
+#[repr(align(64))]
+struct CachePadded<T>(T);
+
+struct Slot<T> {
+    seq: AtomicUsize,
+    value: UnsafeCell<MaybeUninit<T>>,
+}
+
+/// Bounded lock-free MPMC queue (Vyukov). Each slot carries a sequence
+/// number telling producers and consumers whether it is theirs to use.
+struct Queue<T> {
+    mask: usize,
+    slots: Box<[Slot<T>]>,
+    head: CachePadded<AtomicUsize>,
+    tail: CachePadded<AtomicUsize>,
+}
+
+unsafe impl<T: Send> Send for Queue<T> {}
+unsafe impl<T: Send> Sync for Queue<T> {}
+
+impl<T> Queue<T> {
+    /// `capacity` must be a power of two.
+    fn new(capacity: usize) -> Self {
+        let slots = (0..capacity)
+            .map(|i| Slot {
+                seq: AtomicUsize::new(i),
+                value: UnsafeCell::new(MaybeUninit::uninit()),
+            })
+            .collect();
+
+        Queue {
+            mask: capacity - 1,
+            slots,
+            head: CachePadded(AtomicUsize::new(0)),
+            tail: CachePadded(AtomicUsize::new(0)),
+        }
+    }
+
+    fn capacity(&self) -> usize {
+        self.mask + 1
+    }
+
+    fn push(&self, value: T) -> Result<(), T> {
+        let mut pos = self.tail.0.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            let diff = seq as isize - pos as isize;
+            if diff == 0 {
+                match self.tail.0.compare_exchange_weak(
+                    pos,
+                    pos + 1,
+                    Ordering::Relaxed,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => {
+                        unsafe { (*slot.value.get()).as_mut_ptr().write(value) };
+                        slot.seq.store(pos + 1, Ordering::Release);
+                        return Ok(());
+                    }
+                    Err(current) => pos = current,
+                }
+            } else if diff < 0 {
+                return Err(value);
+            } else {
+                pos = self.tail.0.load(Ordering::Relaxed);
+            }
+        }
+    }
+
+    /// Whether the next `pop` would find a value, short of one still being
+    /// written.
+    fn has_ready(&self) -> bool {
+        let pos = self.head.0.load(Ordering::Acquire);
+        let slot = &self.slots[pos & self.mask];
+        slot.seq.load(Ordering::Acquire) == pos + 1
+    }
+
+    fn pop(&self) -> Option<T> {
+        let mut pos = self.head.0.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            let diff = seq as isize - (pos + 1) as isize;
+            if diff == 0 {
+                match self.head.0.compare_exchange_weak(
+                    pos,
+                    pos + 1,
+                    Ordering::Relaxed,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => {
+                        let value = unsafe { (*slot.value.get()).as_ptr().read() };
+                        slot.seq.store(pos + self.mask + 1, Ordering::Release);
+                        return Some(value);
+                    }
+                    Err(current) => pos = current,
+                }
+            } else if diff < 0 {
+                return None;
+            } else {
+                pos = self.head.0.load(Ordering::Relaxed);
+            }
+        }
+    }
+}
+
+impl<T> Drop for Queue<T> {
+    fn drop(&mut self) {
+        while self.pop().is_some() {}
+    }
+}
+
+/// Submission queue entry.
+#[repr(C)]
+pub struct RingSqe {
+    /// Consumed by the ring once the entry is accepted.
+    pub request: *mut Request,
+    /// Copied to the matching completion untouched.
+    pub user_data: u64,
+}
+
+/// Completion queue entry.
+#[repr(C)]
+pub struct RingCqe {
+    /// The `Response`, or null on failure. Owned by the caller.
+    pub response: *mut response::Response,
+    pub user_data: u64,
+    /// Why the request failed; `NoError` when `response` is set.
+    pub error_kind: HttpErrorKind,
+}
+
+struct Completion {
+    response: Option<Box<response::Response>>,
+    user_data: u64,
+    error_kind: HttpErrorKind,
+}
+
+struct Submission {
+    request: Box<Request>,
+    user_data: u64,
+}
+
+/// State shared with the in-flight tasks, which may outlive the handle.
+struct Shared {
+    cq: Queue<Completion>,
+    /// Set once the eventfd has been written and not yet drained by a reap,
+    /// so a burst of completions costs a single wakeup.
+    signalled: AtomicBool,
+    eventfd: i32,
+}
+
+impl Shared {
+    fn complete(&self, completion: Completion) {
+        // Submissions are throttled to the CQ capacity, so this never fails.
+        let _ = self.cq.push(completion);
+        self.signal();
+    }
+
+    /// Make the eventfd readable unless it already is.
+    fn signal(&self) {
+        if self.eventfd >= 0 && !self.signalled.swap(true, Ordering::AcqRel) {
+            let one: u64 = 1;
+            unsafe {
+                libc::write(self.eventfd, &one as *const u64 as *const libc::c_void, 8);
+            }
+        }
+    }
+
+    fn drain_eventfd(&self) {
+        if self.eventfd >= 0 {
+            let mut count: u64 = 0;
+            unsafe {
+                libc::read(self.eventfd, &mut count as *mut u64 as *mut libc::c_void, 8);
+            }
+        }
+    }
+}
+
+impl Drop for Shared {
+    fn drop(&mut self) {
+        if self.eventfd >= 0 {
+            unsafe {
+                libc::close(self.eventfd);
+            }
+        }
+    }
+}
+
+pub struct Ring {
+    client: Client,
+    sq: Queue<Submission>,
+    shared: Arc<Shared>,
+    /// Submitted but not yet reaped; bounded by the CQ capacity.
+    in_flight: AtomicUsize,
+}
+
+#[cfg(target_os = "linux")]
+fn new_eventfd() -> i32 {
+    unsafe { libc::eventfd(0, libc::EFD_NONBLOCK | libc::EFD_CLOEXEC) }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn new_eventfd() -> i32 {
+    -1
+}
+
+/// Create a ring bound to `client` with room for `entries` submissions
+/// (rounded up to a power of two) and twice as many completions.
+#[no_mangle]
+pub unsafe extern "C" fn ring_new(client: *mut Client, entries: u32) -> *mut Ring {
+    if client.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("client handle is null when use ring_new"),
+        );
+        return ptr::null_mut();
+    }
+
+    if entries == 0 {
+        update_last_error(
+            HttpErrorKind::InvalidInput,
+            anyhow!("ring entries must not be 0"),
+        );
+        return ptr::null_mut();
+    }
+
+    let entries = (entries as usize).next_power_of_two();
+    let ring = Ring {
+        client: (*client).clone(),
+        sq: Queue::new(entries),
+        shared: Arc::new(Shared {
+            cq: Queue::new(entries * 2),
+            signalled: AtomicBool::new(false),
+            eventfd: new_eventfd(),
+        }),
+        in_flight: AtomicUsize::new(0),
+    };
+
+    Box::into_raw(Box::new(ring))
+}
+
+/// The eventfd that becomes readable when completions are waiting, or -1 on
+/// platforms without eventfd.
+#[no_mangle]
+pub unsafe extern "C" fn ring_eventfd(handle: *mut Ring) -> i32 {
+    if handle.is_null() {
+        return -1;
+    }
+
+    let ring = &*handle;
+    ring.shared.eventfd
+}
+
+/// Queue `count` entries without starting them. Returns how many were
+/// accepted; the requests of the rest stay owned by the caller.
+#[no_mangle]
+pub unsafe extern "C" fn ring_push(handle: *mut Ring, sqes: *const RingSqe, count: usize) -> usize {
+    if handle.is_null() || (count > 0 && sqes.is_null()) {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("ring handle or sqes is null when use ring_push"),
+        );
+        return 0;
+    }
+
+    let ring = &*handle;
+    let mut accepted = 0;
+    for sqe in slice::from_raw_parts(sqes, count) {
+        if sqe.request.is_null() {
+            break;
+        }
+
+        let submission = Submission {
+            request: Box::from_raw(sqe.request),
+            user_data: sqe.user_data,
+        };
+        if let Err(submission) = ring.sq.push(submission) {
+            // Back to the caller, who still holds the pointer.
+            let _ = Box::into_raw(submission.request);
+            break;
+        }
+        accepted += 1;
+    }
+
+    accepted
+}
+
+/// Start every queued request, as far as the completion queue has room for
+/// its result. Returns the number started. Threads may submit concurrently.
+#[no_mangle]
+pub unsafe extern "C" fn ring_submit(handle: *mut Ring) -> usize {
+    if handle.is_null() {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("ring handle is null when use ring_submit"),
+        );
+        return 0;
+    }
+
+    let ring = &*handle;
+    let cq_capacity = ring.shared.cq.capacity();
+    let mut submitted = 0;
+    loop {
+        // Reserve the completion slot before taking the entry, so concurrent
+        // submitters can never start more than the CQ holds.
+        let reserved = ring
+            .in_flight
+            .fetch_update(Ordering::AcqRel, Ordering::Acquire, |n| {
+                if n < cq_capacity {
+                    Some(n + 1)
+                } else {
+                    None
+                }
+            })
+            .is_ok();
+        if !reserved {
+            break;
+        }
+        let submission = match ring.sq.pop() {
+            Some(v) => v,
+            None => {
+                ring.in_flight.fetch_sub(1, Ordering::AcqRel);
+                break;
+            }
+        };
+
+        let shared = ring.shared.clone();
+        let user_data = submission.user_data;
+        let request = *submission.request;
+        let client = &ring.client;
+        runtime::spawn(move || {
+            client.execute(request).map(move |result| {
+                let completion = match result {
+                    Ok(r) => Completion {
+                        response: Some(Box::new(response::Response::new(Some(r)))),
+                        user_data,
+                        error_kind: HttpErrorKind::NoError,
+                    },
+                    Err(e) => {
+                        let mut kind = HttpErrorKind::NoError;
+                        utils::parse_err(&e, &mut kind);
+                        Completion {
+                            response: None,
+                            user_data,
+                            error_kind: kind,
+                        }
+                    }
+                };
+                shared.complete(completion);
+            })
+        });
+        submitted += 1;
+    }
+
+    submitted
+}
+
+/// Move up to `max` completions into `cqes` without blocking. Returns the
+/// number written. Also re-arms the eventfd notification.
+#[no_mangle]
+pub unsafe extern "C" fn ring_reap(handle: *mut Ring, cqes: *mut RingCqe, max: usize) -> usize {
+    if handle.is_null() || (max > 0 && cqes.is_null()) {
+        update_last_error(
+            HttpErrorKind::HttpHandleNull,
+            anyhow!("ring handle or cqes is null when use ring_reap"),
+        );
+        return 0;
+    }
+
+    let ring = &*handle;
+    // Re-arm before draining: a completion racing with us either lands in
+    // this reap or writes the eventfd again.
+    ring.shared.drain_eventfd();
+    ring.shared.signalled.swap(false, Ordering::AcqRel);
+
+    let out = slice::from_raw_parts_mut(cqes, max);
+    let mut reaped = 0;
+    while reaped < max {
+        let completion = match ring.shared.cq.pop() {
+            Some(v) => v,
+            None => break,
+        };
+
+        out[reaped] = RingCqe {
+            response: completion.response.map_or(ptr::null_mut(), Box::into_raw),
+            user_data: completion.user_data,
+            error_kind: completion.error_kind,
+        };
+        reaped += 1;
+    }
+
+    // Completions beyond `max` keep the eventfd readable; a completion still
+    // being pushed signals on its own since `signalled` is clear.
+    if ring.shared.cq.has_ready() {
+        ring.shared.signal();
+    }
+
+    ring.in_flight.fetch_sub(reaped, Ordering::AcqRel);
+    reaped
+}
+
+/// Destroy the ring. Requests still in flight finish in the background and
+/// their responses are dropped; queued but unsubmitted requests are dropped.
+#[no_mangle]
+pub unsafe extern "C" fn ring_destroy(handle: *mut Ring) {
+    if handle.is_null() {
+        return;
+    }
+
+    drop(Box::from_raw(handle));
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use reqwest::{Method, Url};
+    use response::response_destroy;
+    use std::io::{Read, Write};
+    use std::net::TcpListener;
+    use std::sync::Mutex;
+    use std::thread;
+
+    /// Keep-alive server answering every request with a short 200.
+    fn serve() -> Url {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+        thread::spawn(move || {
+            for stream in listener.incoming() {
+                let mut stream = stream.unwrap();
+                thread::spawn(move || {
+                    let mut buf = [0u8; 4096];
+                    let mut pending = Vec::new();
+                    while let Ok(n) = stream.read(&mut buf) {
+                        if n == 0 {
+                            return;
+                        }
+                        pending.extend_from_slice(&buf[..n]);
+                        while let Some(end) = pending.windows(4).position(|w| w == b"\r\n\r\n") {
+                            pending.drain(..end + 4);
+                            let reply = b"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+                            if stream.write_all(reply).is_err() {
+                                return;
+                            }
+                        }
+                    }
+                });
+            }
+        });
+        Url::parse(&format!("http://{}/", addr)).unwrap()
+    }
+
+    fn sqe(url: &Url, user_data: u64) -> RingSqe {
+        RingSqe {
+            request: Box::into_raw(Box::new(Request::new(Method::GET, url.clone()))),
+            user_data,
+        }
+    }
+
+    fn empty_cqes(n: usize) -> Vec<RingCqe> {
+        (0..n)
+            .map(|_| RingCqe {
+                response: ptr::null_mut(),
+                user_data: 0,
+                error_kind: HttpErrorKind::NoError,
+            })
+            .collect()
+    }
+
+    /// Wait up to a few seconds for the eventfd to become readable.
+    #[cfg(target_os = "linux")]
+    fn wait_readable(fd: i32) -> bool {
+        poll_readable(fd, 5000)
+    }
+
+    #[cfg(target_os = "linux")]
+    fn poll_readable(fd: i32, timeout_ms: i32) -> bool {
+        let mut pfd = libc::pollfd {
+            fd,
+            events: libc::POLLIN,
+            revents: 0,
+        };
+        unsafe { libc::poll(&mut pfd, 1, timeout_ms) == 1 }
+    }
+
+    /// Reap into `seen`, checking every response, and return how many came.
+    unsafe fn reap_into(ring: *mut Ring, cqes: &mut [RingCqe], seen: &Mutex<Vec<u64>>) -> usize {
+        let n = ring_reap(ring, cqes.as_mut_ptr(), cqes.len());
+        for cqe in &cqes[..n] {
+            assert!(!cqe.response.is_null(), "request {} failed", cqe.user_data);
+            assert_eq!((*cqe.response).inner.as_ref().unwrap().status(), 200);
+            response_destroy(cqe.response);
+            seen.lock().unwrap().push(cqe.user_data);
+        }
+        n
+    }
+
+    #[test]
+    #[cfg(target_os = "linux")]
+    fn push_submit_reap_through_eventfd() {
+        let url = serve();
+        let mut client = Client::new();
+        let ring = unsafe { ring_new(&mut client, 4) };
+        let fd = unsafe { ring_eventfd(ring) };
+        assert!(fd >= 0);
+
+        let sqes: Vec<_> = (0..3).map(|i| sqe(&url, 100 + i)).collect();
+        let seen = Mutex::new(Vec::new());
+        let mut cqes = empty_cqes(8);
+        unsafe {
+            assert_eq!(ring_push(ring, sqes.as_ptr(), sqes.len()), 3);
+            assert_eq!(ring_submit(ring), 3);
+            while seen.lock().unwrap().len() < 3 {
+                assert!(wait_readable(fd), "no completion signalled");
+                reap_into(ring, &mut cqes, &seen);
+            }
+            // Drained and re-armed: nothing left to signal.
+            assert!(ring_reap(ring, cqes.as_mut_ptr(), cqes.len()) == 0);
+            ring_destroy(ring);
+        }
+
+        let mut seen = seen.into_inner().unwrap();
+        seen.sort();
+        assert_eq!(seen, [100, 101, 102]);
+    }
+
+    /// Reaping fewer completions than are waiting leaves the eventfd
+    /// readable, so an epoll loop comes back for the rest.
+    #[test]
+    #[cfg(target_os = "linux")]
+    fn partial_reap_keeps_the_eventfd_readable() {
+        let url = serve();
+        let mut client = Client::new();
+        let ring = unsafe { ring_new(&mut client, 4) };
+        let fd = unsafe { ring_eventfd(ring) };
+
+        let sqes: Vec<_> = (0..3).map(|i| sqe(&url, i)).collect();
+        let seen = Mutex::new(Vec::new());
+        let mut one = empty_cqes(1);
+        unsafe {
+            assert_eq!(ring_push(ring, sqes.as_ptr(), sqes.len()), 3);
+            assert_eq!(ring_submit(ring), 3);
+            // All three completed and none reaped yet.
+            let cq = &(&*ring).shared.cq;
+            let started = std::time::Instant::now();
+            while cq.tail.0.load(Ordering::Acquire) < 3 {
+                assert!(started.elapsed().as_secs() < 5, "requests did not complete");
+                thread::sleep(std::time::Duration::from_millis(1));
+            }
+
+            for left in (0..3).rev() {
+                assert!(
+                    wait_readable(fd),
+                    "{} completions waiting unsignalled",
+                    left + 1
+                );
+                assert_eq!(reap_into(ring, &mut one, &seen), 1);
+            }
+            assert!(!poll_readable(fd, 0), "readable with nothing waiting");
+            ring_destroy(ring);
+        }
+        assert_eq!(seen.into_inner().unwrap().len(), 3);
+    }
+
+    /// Several threads pushing, submitting and reaping on one small ring get
+    /// every completion back exactly once.
+    #[test]
+    #[cfg(target_os = "linux")]
+    fn concurrent_submitters_lose_nothing() {
+        const THREADS: u64 = 4;
+        const EACH: u64 = 50;
+
+        let url = serve();
+        let mut client = Client::new();
+        let ring = unsafe { ring_new(&mut client, 2) } as usize;
+        let seen = Mutex::new(Vec::new());
+
+        thread::scope(|s| {
+            for t in 0..THREADS {
+                let (url, seen) = (&url, &seen);
+                s.spawn(move || unsafe {
+                    let ring = ring as *mut Ring;
+                    let fd = ring_eventfd(ring);
+                    let mut cqes = empty_cqes(4);
+                    let mut next = 0;
+                    while (seen.lock().unwrap().len() as u64) < THREADS * EACH {
+                        if next < EACH {
+                            let entry = sqe(url, t * 1000 + next);
+                            if ring_push(ring, &entry, 1) == 1 {
+                                next += 1;
+                            } else {
+                                drop(Box::from_raw(entry.request));
+                            }
+                        }
+                        ring_submit(ring);
+                        if reap_into(ring, &mut cqes, seen) == 0 && next == EACH {
+                            let mut pfd = libc::pollfd {
+                                fd,
+                                events: libc::POLLIN,
+                                revents: 0,
+                            };
+                            libc::poll(&mut pfd, 1, 10);
+                        }
+                    }
+                });
+            }
+        });
+        unsafe { ring_destroy(ring as *mut Ring) };
+
+        let mut seen = seen.into_inner().unwrap();
+        seen.sort();
+        let expected: Vec<u64> = (0..THREADS)
+            .flat_map(|t| (0..EACH).map(move |i| t * 1000 + i))
+            .collect();
+        assert_eq!(seen, expected);
+    }
+
+    #[test]
+    fn queue_wraps_and_reports_full() {
+        let queue = Queue::new(4);
+        for round in 0..3 {
+            for i in 0..4 {
+                assert!(queue.push(round * 4 + i).is_ok());
+            }
+            assert_eq!(queue.push(99), Err(99));
+            for i in 0..4 {
+                assert_eq!(queue.pop(), Some(round * 4 + i));
+            }
+            assert_eq!(queue.pop(), None);
+        }
+    }
+}
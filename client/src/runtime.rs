@@ -0,0 +1,319 @@
+use anyhow::anyhow;
+use ffi::update_last_error;
+use http_err::HttpErrorKind;
+use std::future::Future;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, OnceLock};
+use tokio::runtime::{Builder, Handle, Runtime};
+
+static RUNTIME: OnceLock<Runtime> = OnceLock::new();
+
+fn build(worker_threads: usize, pin_cores: bool) -> std::io::Result<Runtime> {
+    let mut builder = Builder::new_multi_thread();
+    builder.enable_all().thread_name("crab-http-worker");
+    if pin_cores {
+        // Counted here rather than left to tokio, to know which to pin.
+        let workers = match worker_threads {
+            0 => std::thread::available_parallelism().map_or(1, |n| n.get()),
+            n => n,
+        };
+        builder.worker_threads(workers);
+
+        // The workers are the first threads started, while the runtime is
+        // built; threads the blocking pool adds later stay unpinned.
+        let started = Arc::new(AtomicUsize::new(0));
+        builder.on_thread_start(move || {
+            let index = started.fetch_add(1, Ordering::Relaxed);
+            if index < workers {
+                pin_current_thread(index);
+            }
+        });
+    } else if worker_threads > 0 {
+        builder.worker_threads(worker_threads);
+    }
+    builder.build()
+}
+
+/// Pin the calling thread to the `index`th CPU it is allowed to run on,
+/// wrapping around.
+#[cfg(target_os = "linux")]
+fn pin_current_thread(index: usize) {
+    unsafe {
+        let size = std::mem::size_of::<libc::cpu_set_t>();
+        let mut allowed: libc::cpu_set_t = std::mem::zeroed();
+        if libc::sched_getaffinity(0, size, &mut allowed) != 0 {
+            return;
+        }
+
+        let cpus: Vec<usize> = (0..libc::CPU_SETSIZE as usize)
+            .filter(|&cpu| libc::CPU_ISSET(cpu, &allowed))
+            .collect();
+        if cpus.is_empty() {
+            return;
+        }
+
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        libc::CPU_SET(cpus[index % cpus.len()], &mut set);
+        libc::sched_setaffinity(0, size, &set);
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn pin_current_thread(_index: usize) {}
+
+/// The process-wide multi-threaded runtime every `Client` runs on.
+///
+/// Built lazily on first use with one worker per core unless
+/// `runtime_init` configured it first; all clients share its workers and
+/// timers instead of each owning a private runtime thread.
+pub fn runtime() -> &'static Runtime {
+    RUNTIME.get_or_init(|| build(0, false).expect("build crab_http runtime failed"))
+}
+
+/// Configure the shared runtime all clients run on.
+///
+/// `worker_threads` of 0 means one per core. With `pin_cores` each worker
+/// thread is pinned to its own CPU, round robin (Linux only, ignored
+/// elsewhere); threads started later for `spawn_blocking` or to stand in for
+/// a worker in `block_in_place` are not.
+///
+/// Must be called before the first client is built or request is sent;
+/// returns `false` if the runtime is already running or could not be built.
+#[no_mangle]
+pub extern "C" fn runtime_init(worker_threads: u32, pin_cores: bool) -> bool {
+    if RUNTIME.get().is_some() {
+        update_last_error(
+            HttpErrorKind::Other,
+            anyhow!("runtime already started when use runtime_init"),
+        );
+        return false;
+    }
+
+    let rt = match build(worker_threads as usize, pin_cores) {
+        Ok(rt) => rt,
+        Err(e) => {
+            update_last_error(
+                HttpErrorKind::Other,
+                anyhow!(e).context("Unable to build runtime"),
+            );
+            return false;
+        }
+    };
+
+    if let Err(rt) = RUNTIME.set(rt) {
+        drop(rt);
+        update_last_error(
+            HttpErrorKind::Other,
+            anyhow!("runtime already started when use runtime_init"),
+        );
+        return false;
+    }
+
+    true
+}
+
+/// Number of worker threads of the shared runtime, starting it if needed.
+#[no_mangle]
+pub extern "C" fn runtime_worker_threads() -> u32 {
+    runtime().metrics().num_workers() as u32
+}
+
+/// Create the future returned by `make` and drive it to completion on behalf
+/// of a blocking caller.
+///
+/// The future is created inside the runtime context because reqwest arms its
+/// timeout timers as soon as `send`/`execute` is called, not on first poll.
+///
+/// A caller that is already a runtime worker (e.g. C++ code running inside a
+/// `send_async` callback) is moved off the scheduler first, so blocking there
+/// neither panics nor stalls the other in-flight requests.
+pub fn block_on<F, T>(make: F) -> T::Output
+where
+    F: FnOnce() -> T,
+    T: Future,
+{
+    match Handle::try_current() {
+        Ok(handle) => tokio::task::block_in_place(|| handle.block_on(make())),
+        Err(_) => {
+            let rt = runtime();
+            let _guard = rt.enter();
+            rt.block_on(make())
+        }
+    }
+}
+
+/// Create the future returned by `make` inside the runtime context and run it
+/// in the background.
+pub fn spawn<F, T>(make: F)
+where
+    F: FnOnce() -> T,
+    T: Future<Output = ()> + Send + 'static,
+{
+    let rt = runtime();
+    let _guard = rt.enter();
+    rt.spawn(make());
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use futures_util::{future, FutureExt, StreamExt};
+    use std::io::{Read, Write};
+    use std::net::TcpListener;
+    use std::time::{Duration, Instant};
+
+    /// Keep-alive HTTP/1.1 server answering every request with "ok".
+    fn serve() -> String {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+        std::thread::spawn(move || {
+            for stream in listener.incoming() {
+                let mut stream = stream.unwrap();
+                std::thread::spawn(move || {
+                    let mut buf = [0u8; 4096];
+                    let mut pending = Vec::new();
+                    while let Ok(n) = stream.read(&mut buf) {
+                        if n == 0 {
+                            break;
+                        }
+                        pending.extend_from_slice(&buf[..n]);
+                        while let Some(end) = pending.windows(4).position(|w| w == b"\r\n\r\n") {
+                            pending.drain(..end + 4);
+                            let resp = b"HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+                            if stream.write_all(resp).is_err() {
+                                return;
+                            }
+                        }
+                    }
+                });
+            }
+        });
+        format!("http://{}/", addr)
+    }
+
+    /// Threads of this process named like the runtime workers.
+    fn runtime_threads() -> usize {
+        std::fs::read_dir("/proc/self/task")
+            .map(|tasks| {
+                tasks
+                    .filter_map(|t| t.ok())
+                    .filter_map(|t| std::fs::read_to_string(t.path().join("comm")).ok())
+                    .filter(|comm| comm.starts_with("crab-http"))
+                    .count()
+            })
+            .unwrap_or(0)
+    }
+
+    /// 100 clients, 50 sequential requests each, all in flight at once.
+    ///
+    /// cargo test --release bench_shared_runtime -- --ignored --nocapture
+    #[test]
+    #[ignore]
+    fn bench_shared_runtime() {
+        const CLIENTS: usize = 100;
+        const REQUESTS: usize = 50;
+
+        let url = serve();
+        let clients: Vec<reqwest::Client> = (0..CLIENTS)
+            .map(|_| reqwest::Client::builder().build().unwrap())
+            .collect();
+
+        let started = Instant::now();
+        let url = url.as_str();
+        let per_client = block_on(|| {
+            future::join_all(clients.iter().map(|client| {
+                futures_util::stream::iter(0..REQUESTS)
+                    .then(move |_| {
+                        let t = Instant::now();
+                        client.get(url).send().map(move |r| {
+                            assert!(r.unwrap().status().is_success());
+                            t.elapsed()
+                        })
+                    })
+                    .collect::<Vec<Duration>>()
+            }))
+        });
+        let elapsed = started.elapsed();
+
+        let mut latencies: Vec<Duration> = per_client.into_iter().flatten().collect();
+        latencies.sort();
+        let pct = |p: usize| latencies[(latencies.len() * p / 100).min(latencies.len() - 1)];
+
+        println!(
+            "{} clients x {} requests in {:?}: {} workers, {} runtime threads, p50 {:?}, p99 {:?}",
+            CLIENTS,
+            REQUESTS,
+            elapsed,
+            runtime_worker_threads(),
+            runtime_threads(),
+            pct(50),
+            pct(99)
+        );
+    }
+
+    /// Name of the global allocator this build uses.
+    fn allocator() -> &'static str {
+        if cfg!(feature = "mimalloc") {
+            "mimalloc"
+        } else if cfg!(feature = "jemalloc") {
+            "jemalloc"
+        } else {
+            "system"
+        }
+    }
+
+    /// Allocation-heavy request loops from several caller threads at once:
+    /// per request a handful of headers, a header map copy, the url and the
+    /// body, as a typical FFI caller would take them.
+    ///
+    /// Compare builds with:
+    /// cargo test --release bench_allocator -- --ignored --nocapture
+    /// cargo test --release --features mimalloc bench_allocator -- --ignored --nocapture
+    /// cargo test --release --features jemalloc bench_allocator -- --ignored --nocapture
+    #[test]
+    #[ignore]
+    fn bench_allocator() {
+        const THREADS: usize = 8;
+        const REQUESTS: usize = 2000;
+
+        let url = serve();
+        let client = reqwest::Client::builder().build().unwrap();
+
+        let started = Instant::now();
+        std::thread::scope(|scope| {
+            for t in 0..THREADS {
+                let client = &client;
+                let url = url.as_str();
+                scope.spawn(move || {
+                    for i in 0..REQUESTS {
+                        let resp = block_on(|| {
+                            client
+                                .get(url)
+                                .header("x-thread", t.to_string())
+                                .header("x-request", i.to_string())
+                                .header("accept", "application/json")
+                                .query(&[("page", i.to_string()), ("q", "crab".to_string())])
+                                .send()
+                        })
+                        .unwrap();
+                        let headers = resp.headers().clone();
+                        let url = resp.url().to_string();
+                        let body = block_on(|| resp.bytes()).unwrap().to_vec();
+                        assert_eq!(body, b"ok");
+                        drop((headers, url));
+                    }
+                });
+            }
+        });
+        let elapsed = started.elapsed();
+
+        println!(
+            "{}: {} threads x {} requests in {:?}, {:.0} req/s",
+            allocator(),
+            THREADS,
+            REQUESTS,
+            elapsed,
+            (THREADS * REQUESTS) as f64 / elapsed.as_secs_f64()
+        );
+    }
+}
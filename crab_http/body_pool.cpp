@@ -0,0 +1,11 @@
+#include "body_pool.h"
+
+namespace crab::http
+{
+BodyPoolStats GetBodyPoolStats()
+{
+    BodyPoolStats stats{};
+    body_pool_stats(&stats);
+    return stats;
+}
+} // namespace crab::http
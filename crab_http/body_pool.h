@@ -0,0 +1,10 @@
+#pragma once
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+/// Counters of the response body buffer pool shared by every `Client` in the
+/// process. Its limits are set with `ClientBuilder::body_pool()`.
+BodyPoolStats GetBodyPoolStats();
+} // namespace crab::http
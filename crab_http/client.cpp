@@ -4,6 +4,7 @@
 #include "request.h"
 #include "request_builder.h"
 #include "response.h"
+#include "ring.h"
 
 namespace crab::http
 {
@@ -21,9 +22,9 @@ Client::uptr Client::Build(void *handle)
     return Create(handle);
 }
 
-std::unique_ptr<RequestBuilder> Client::get(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::get(std::string_view url)
 {
-    auto builder = client_get(handle_, url.c_str());
+    auto builder = client_get_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -31,9 +32,9 @@ std::unique_ptr<RequestBuilder> Client::get(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::delete_(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::delete_(std::string_view url)
 {
-    auto builder = client_delete(handle_, url.c_str());
+    auto builder = client_delete_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -41,9 +42,9 @@ std::unique_ptr<RequestBuilder> Client::delete_(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::head(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::head(std::string_view url)
 {
-    auto builder = client_head(handle_, url.c_str());
+    auto builder = client_head_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -51,9 +52,9 @@ std::unique_ptr<RequestBuilder> Client::head(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::patch(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::patch(std::string_view url)
 {
-    auto builder = client_patch(handle_, url.c_str());
+    auto builder = client_patch_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -61,9 +62,9 @@ std::unique_ptr<RequestBuilder> Client::patch(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::post(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::post(std::string_view url)
 {
-    auto builder = client_post(handle_, url.c_str());
+    auto builder = client_post_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -71,9 +72,9 @@ std::unique_ptr<RequestBuilder> Client::post(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::put(const std::string &url)
+std::unique_ptr<RequestBuilder> Client::put(std::string_view url)
 {
-    auto builder = client_put(handle_, url.c_str());
+    auto builder = client_put_len(handle_, reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -81,9 +82,10 @@ std::unique_ptr<RequestBuilder> Client::put(const std::string &url)
     return RequestBuilder::Build(builder);
 }
 
-std::unique_ptr<RequestBuilder> Client::request(const std::string &method, const std::string &url)
+std::unique_ptr<RequestBuilder> Client::request(std::string_view method, std::string_view url)
 {
-    auto builder = client_request(handle_, method.c_str(), url.c_str());
+    auto builder = client_request_len(handle_, reinterpret_cast<const uint8_t *>(method.data()), method.size(),
+                                      reinterpret_cast<const uint8_t *>(url.data()), url.size());
     if (!builder)
     {
         return nullptr;
@@ -106,4 +108,81 @@ std::unique_ptr<Response> Client::execute(std::unique_ptr<Request> request)
 
     return Response::Build(resp);
 }
+
+std::unique_ptr<Response> Client::send(const RequestDescriptor &desc)
+{
+    if (!handle_)
+    {
+        return nullptr;
+    }
+
+    auto resp = client_send_descriptor(handle_, &desc);
+    if (!resp)
+    {
+        return nullptr;
+    }
+    return Response::Build(resp);
+}
+
+std::vector<std::unique_ptr<Response>> Client::execute_batch(std::vector<std::unique_ptr<Request>> requests, size_t max_in_flight)
+{
+    std::vector<std::unique_ptr<Response>> responses(requests.size());
+    if (!handle_ || requests.empty())
+    {
+        return responses;
+    }
+
+    std::vector<void *> handles;
+    handles.reserve(requests.size());
+    for (auto &request : requests)
+    {
+        handles.push_back(request ? request->Handle() : nullptr);
+    }
+
+    std::vector<void *> resps(requests.size(), nullptr);
+    if (!client_execute_batch(handle_, handles.data(), handles.size(), max_in_flight, resps.data()))
+    {
+        return responses;
+    }
+
+    for (auto &request : requests)
+    {
+        if (request)
+        {
+            request->ResetHandle();
+        }
+    }
+
+    for (size_t i = 0; i < resps.size(); ++i)
+    {
+        if (resps[i])
+        {
+            responses[i] = Response::Build(resps[i]);
+        }
+    }
+    return responses;
+}
+
+std::unique_ptr<Ring> Client::ring(uint32_t entries)
+{
+    auto handle = ring_new(handle_, entries);
+    if (!handle)
+    {
+        return nullptr;
+    }
+    return Ring::Build(handle, entries);
+}
+
+#if defined(_WIN32) || defined(_MSC_VER)
+bool Client::download(const std::string &url, const std::wstring &path, const DownloadOptions &options, DownloadStats *stats)
+{
+    return client_download_wide(handle_, url.c_str(), path.c_str(), path.size(), &options, stats);
+}
+
+#else
+bool Client::download(const std::string &url, const std::string &path, const DownloadOptions &options, DownloadStats *stats)
+{
+    return client_download(handle_, url.c_str(), path.c_str(), &options, stats);
+}
+#endif
 } // namespace crab::http
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "crab_http_c.h"
 
 namespace crab::http
 {
@@ -9,6 +13,7 @@ class RequestBuilder;
 class Request;
 class Response;
 class ClientBuilder;
+class Ring;
 
 class Client
 {
@@ -55,42 +60,42 @@ class Client
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> get(const std::string &url);
+    std::unique_ptr<RequestBuilder> get(std::string_view url);
 
     /// Convenience method to make a `DELETE` request to a URL.
     ///
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> delete_(const std::string &url);
+    std::unique_ptr<RequestBuilder> delete_(std::string_view url);
 
     /// Convenience method to make a `HEAD` request to a URL.
     ///
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> head(const std::string &url);
+    std::unique_ptr<RequestBuilder> head(std::string_view url);
 
     /// Convenience method to make a `PATCH` request to a URL.
     ///
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> patch(const std::string &url);
+    std::unique_ptr<RequestBuilder> patch(std::string_view url);
 
     /// Convenience method to make a `POST` request to a URL.
     ///
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> post(const std::string &url);
+    std::unique_ptr<RequestBuilder> post(std::string_view url);
 
     /// Convenience method to make a `PUT` request to a URL.
     ///
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> put(const std::string &url);
+    std::unique_ptr<RequestBuilder> put(std::string_view url);
 
     /// Start building a `Request` with the `Method` and `Url`.
     ///
@@ -100,7 +105,7 @@ class Client
     /// # Errors
     ///
     /// This method fails whenever supplied `Url` cannot be parsed.
-    std::unique_ptr<RequestBuilder> request(const std::string &method, const std::string &url);
+    std::unique_ptr<RequestBuilder> request(std::string_view method, std::string_view url);
 
     /// Executes a `Request`.
     ///
@@ -116,6 +121,39 @@ class Client
     /// or redirect limit was exhausted.
     std::unique_ptr<Response> execute(std::unique_ptr<Request> request);
 
+    /// Executes a batch of `Request`s concurrently with a single call into
+    /// the runtime, keeping at most `max_in_flight` of them in flight at once
+    /// (0 means no limit).
+    ///
+    /// Blocks until every request has finished. The result holds one entry
+    /// per request, in the same order; a failed request yields nullptr and
+    /// `TakeLastError()` reports the most recent failure.
+    std::vector<std::unique_ptr<Response>> execute_batch(std::vector<std::unique_ptr<Request>> requests, size_t max_in_flight);
+
+    /// Build and send the request `desc` describes in one call, instead of
+    /// one call per `RequestBuilder` method. `desc` is only read during the
+    /// call; fill its spans with `Span()`, and `method` and `version` with
+    /// `static_cast<uint32_t>` of an `HttpMethod` and `HttpVersion`.
+    std::unique_ptr<Response> send(const RequestDescriptor &desc);
+
+    /// Create a submission/completion `Ring` that sends through this client.
+    ///
+    /// `entries` bounds the submission queue and is rounded up to a power of
+    /// two; the completion queue holds twice as many.
+    std::unique_ptr<Ring> ring(uint32_t entries);
+
+    /// Download `url` to the file at `path` over several connections, each
+    /// fetching a byte range and writing it in place.
+    ///
+    /// Servers that don't advertise range support get a single GET. With
+    /// `options.resume` an interrupted download continues from the segments
+    /// it had finished. Fills `stats` when given. Returns false on failure.
+#if defined(_WIN32) || defined(_MSC_VER)
+    bool download(const std::string &url, const std::wstring &path, const DownloadOptions &options = {}, DownloadStats *stats = nullptr);
+#else
+    bool download(const std::string &url, const std::string &path, const DownloadOptions &options = {}, DownloadStats *stats = nullptr);
+#endif
+
   private:
     void *handle_{nullptr};
 };
@@ -60,10 +60,7 @@ ClientBuilder *ClientBuilder::default_headers(std::unique_ptr<HeaderMap> headerM
 ClientBuilder *ClientBuilder::default_headers(std::initializer_list<Pair> headers)
 {
     HeaderMap::uptr headerMap = HeaderMap::Build();
-    for (auto &item : headers)
-    {
-        headerMap->insert(item.key, item.value);
-    }
+    headerMap->insert_many(headers.begin(), headers.size());
     auto builder = client_builder_default_headers(handle_, headerMap->Handle());
     if (builder)
     {
@@ -400,6 +397,16 @@ ClientBuilder *ClientBuilder::connect_timeout(const uint64_t millisecond)
     return this;
 }
 
+ClientBuilder *ClientBuilder::body_pool(const BodyPoolLimits &limits)
+{
+    auto builder = client_builder_body_pool(handle_, &limits);
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
 ClientBuilder *ClientBuilder::tls_built_in_root_certs(bool tls_built_in_root_certs)
 {
     auto builder = client_builder_tls_built_in_root_certs(handle_, tls_built_in_root_certs);
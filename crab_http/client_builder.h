@@ -9,6 +9,7 @@ namespace crab::http
 class Client;
 class HeaderMap;
 struct Pair;
+struct BodyPoolLimits;
 class Proxy;
 
 class ClientBuilder
@@ -253,6 +254,14 @@ class ClientBuilder
 
     ClientBuilder *connect_timeout(uint64_t millisecond);
 
+    /// Set the limits of the size-classed pool that response bodies are read
+    /// into and return to when freed.
+    ///
+    /// The pool is shared by every client in the process, so the limits of
+    /// the client built last apply. Value-initialised limits turn pooling off.
+    /// See `GetBodyPoolStats()` for hit rates.
+    ClientBuilder *body_pool(const BodyPoolLimits &limits);
+
     /// Controls the use of built-in system certificates during certificate
     /// validation.
     ///
@@ -0,0 +1,204 @@
+#pragma once
+
+// C++20 coroutine support. Everything below compiles away on compilers or
+// language modes without coroutines, so including this header from C++17
+// code is harmless.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define CRAB_HTTP_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "crab_http_c.h"
+#include "request_builder.h"
+#include "resp_body.h"
+#include "response.h"
+
+namespace crab::http
+{
+/// Awaiter returned by `RequestBuilder::send_async()`.
+///
+/// The awaiting coroutine is resumed on a runtime worker thread with the
+/// `Response`, or nullptr on failure, in which case `TakeLastError()` on that
+/// thread returns the reason.
+class SendAwaiter
+{
+    friend class RequestBuilder;
+
+  private:
+    explicit SendAwaiter(void *handle) : handle_(handle)
+    {
+    }
+
+    // The coroutine must not throw out of resume(): unwinding into the Rust
+    // runtime is undefined behaviour, so terminate instead.
+    static void OnResponse(void *user_data, void *response) noexcept
+    {
+        auto self = static_cast<SendAwaiter *>(user_data);
+        self->response_ = response;
+        self->awaiting_.resume();
+    }
+
+  public:
+    SendAwaiter(const SendAwaiter &) = delete;
+
+    SendAwaiter &operator=(const SendAwaiter &) = delete;
+
+    ~SendAwaiter()
+    {
+        request_builder_destroy(handle_);
+        response_destroy(response_);
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    // `this` may already be gone once the request is queued, so nothing is
+    // touched after handing it over.
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        awaiting_ = awaiting;
+        return request_builder_send_async(std::exchange(handle_, nullptr), &SendAwaiter::OnResponse, this);
+    }
+
+    std::unique_ptr<Response> await_resume()
+    {
+        if (!response_)
+        {
+            return nullptr;
+        }
+        return Response::Build(std::exchange(response_, nullptr));
+    }
+
+  private:
+    void *handle_{nullptr};
+    void *response_{nullptr};
+    std::coroutine_handle<> awaiting_;
+};
+
+/// Awaiter returned by `Response::bodyBytesAsync()`.
+///
+/// Resumes on a runtime worker thread with the body, or nullptr on failure.
+class BodyAwaiter
+{
+    friend class Response;
+
+  private:
+    explicit BodyAwaiter(void *handle) : handle_(handle)
+    {
+    }
+
+    static void OnBody(void *user_data, void *body) noexcept
+    {
+        auto self = static_cast<BodyAwaiter *>(user_data);
+        self->body_ = body;
+        self->awaiting_.resume();
+    }
+
+  public:
+    BodyAwaiter(const BodyAwaiter &) = delete;
+
+    BodyAwaiter &operator=(const BodyAwaiter &) = delete;
+
+    ~BodyAwaiter()
+    {
+        free_resp_body(body_);
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        awaiting_ = awaiting;
+        return response_bytes_async(handle_, &BodyAwaiter::OnBody, this);
+    }
+
+    std::unique_ptr<ResponseBody> await_resume()
+    {
+        if (!body_)
+        {
+            return nullptr;
+        }
+        return ResponseBody::Create(std::exchange(body_, nullptr));
+    }
+
+  private:
+    void *handle_{nullptr};
+    void *body_{nullptr};
+    std::coroutine_handle<> awaiting_;
+};
+
+/// Awaiter returned by `Response::read_async()`.
+///
+/// Resumes on a runtime worker thread with the number of bytes read, 0 once
+/// the body is exhausted and -1 on failure.
+class ReadAwaiter
+{
+    friend class Response;
+
+  private:
+    ReadAwaiter(void *handle, uint8_t *buf, uint32_t buf_len) : handle_(handle), buf_(buf), buf_len_(buf_len)
+    {
+    }
+
+    static void OnRead(void *user_data, int32_t count) noexcept
+    {
+        auto self = static_cast<ReadAwaiter *>(user_data);
+        self->count_ = count;
+        self->awaiting_.resume();
+    }
+
+  public:
+    ReadAwaiter(const ReadAwaiter &) = delete;
+
+    ReadAwaiter &operator=(const ReadAwaiter &) = delete;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        awaiting_ = awaiting;
+        return response_read_async(handle_, buf_, buf_len_, &ReadAwaiter::OnRead, this);
+    }
+
+    int32_t await_resume() const noexcept
+    {
+        return count_;
+    }
+
+  private:
+    void *handle_{nullptr};
+    uint8_t *buf_{nullptr};
+    uint32_t buf_len_{0};
+    int32_t count_{-1};
+    std::coroutine_handle<> awaiting_;
+};
+
+inline SendAwaiter RequestBuilder::send_async()
+{
+    return SendAwaiter(std::exchange(handle_, nullptr));
+}
+
+inline BodyAwaiter Response::bodyBytesAsync()
+{
+    return BodyAwaiter(handle_);
+}
+
+inline ReadAwaiter Response::read_async(uint8_t *buf, uint32_t buf_len)
+{
+    return ReadAwaiter(handle_, buf, buf_len);
+}
+} // namespace crab::http
+
+#endif
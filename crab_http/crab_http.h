@@ -1,11 +1,20 @@
 #pragma once
+#include "body_pool.h"
 #include "client.h"
 #include "client_builder.h"
+#include "coroutine.h"
 #include "header_map.h"
+#include "header_name.h"
+#include "header_value.h"
 #include "http_exception.h"
+#include "json_writer.h"
+#include "meta.h"
 #include "proxy.h"
 #include "r_string.h"
 #include "request.h"
 #include "request_builder.h"
+#include "request_template.h"
 #include "resp_body.h"
-#include "response.h"
\ No newline at end of file
+#include "response.h"
+#include "ring.h"
+#include "runtime.h"
\ No newline at end of file
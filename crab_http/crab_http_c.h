@@ -8,6 +8,16 @@
 
 namespace crab::http {
 
+/// How to flush a written file to stable storage.
+enum class FsyncPolicy {
+  /// Leave it to the page cache.
+  None,
+  /// `fdatasync`: file contents, not metadata such as mtime.
+  Data,
+  /// `fsync`: contents and metadata.
+  All,
+};
+
 enum class HttpErrorKind {
   NoError,
   /// An entity was not found, often a file.
@@ -183,13 +193,232 @@ enum class HttpErrorKind {
   HttpUpgrade,
 };
 
+enum class HttpMethod {
+  Get,
+  Post,
+  Put,
+  Delete,
+  Head,
+  Options,
+  Patch,
+  Connect,
+  Trace,
+};
+
+enum class HttpVersion {
+  Http09,
+  Http10,
+  Http11,
+  Http2,
+  Http3,
+  Unknown,
+};
+
 struct Pair {
   const char *key;
   const char *value;
 };
 
+/// Allocation hook supplied by the caller.
+///
+/// `alloc` returns `size` bytes aligned to `align`, or null. The memory is
+/// the caller's: this library never frees it, so an arena may reclaim it
+/// all at once.
+struct Allocator {
+  uint8_t *(*alloc)(void *user_data, uintptr_t size, uintptr_t align);
+  void *user_data;
+};
+
+/// Limits of the body buffer pool. All zeroes disables it.
+struct BodyPoolLimits {
+  /// Largest buffer kept, rounded up to a power of two between 1 KiB and
+  /// 16 MiB. Bodies above it are allocated and freed as before.
+  uintptr_t max_buffer;
+  /// Bytes each thread may keep for itself.
+  uintptr_t thread_cache_bytes;
+  /// Bytes kept in the depot shared by all threads.
+  uintptr_t shared_bytes;
+};
+
+/// Counters since the process started.
+struct BodyPoolStats {
+  /// Buffers served from the calling thread's cache.
+  uint64_t thread_hits;
+  /// Buffers served from the shared depot.
+  uint64_t shared_hits;
+  /// Poolable requests that had to allocate.
+  uint64_t misses;
+  /// Buffers freed because every cache was full.
+  uint64_t discarded;
+  /// Bytes currently held in the shared depot.
+  uint64_t shared_bytes;
+};
+
+/// Options for `client_download`. All zeroes is a sensible default.
+struct DownloadOptions {
+  /// Concurrent range requests; 0 means 4.
+  uint32_t connections;
+  /// Bytes per range request; 0 means 8 MiB.
+  uint64_t segment_size;
+  /// Record finished segments in `<path>.crabdl` and skip them when the
+  /// same object is downloaded to the same path again.
+  bool resume;
+  /// Applied to the file before each segment is recorded and at the end.
+  FsyncPolicy fsync;
+};
+
+/// What `client_download` did.
+struct DownloadStats {
+  /// Size of the object.
+  uint64_t length;
+  /// Bytes fetched by this call; less than `length` after a resume.
+  uint64_t bytes_fetched;
+  /// Range requests the object was split into; 0 if the server doesn't
+  /// support ranges and it was fetched in one piece.
+  uint32_t segments;
+  /// Segments skipped because an earlier run had finished them.
+  uint32_t segments_resumed;
+  uint64_t elapsed_us;
+};
+
+/// Options for `response_save_to_file`. All zeroes is a sensible default.
+struct SaveOptions {
+  /// Reserve `Content-Length` bytes up front, when the length is known.
+  bool preallocate;
+  /// Bypass the page cache with `O_DIRECT` where the filesystem allows it.
+  bool direct_io;
+  /// Bytes per write, rounded up to 4 KiB; 0 means 1 MiB.
+  uintptr_t write_size;
+  FsyncPolicy fsync;
+};
+
+/// What `response_save_to_file` did, times in microseconds.
+struct SaveStats {
+  uint64_t bytes_written;
+  /// From the call until the file was synced.
+  uint64_t elapsed_us;
+  /// Spent inside write calls.
+  uint64_t write_us;
+  /// Spent in fsync/fdatasync.
+  uint64_t sync_us;
+};
+
+/// Submission queue entry.
+struct RingSqe {
+  /// Consumed by the ring once the entry is accepted.
+  void *request;
+  /// Copied to the matching completion untouched.
+  uint64_t user_data;
+};
+
+/// Completion queue entry.
+struct RingCqe {
+  /// The `Response`, or null on failure. Owned by the caller.
+  void *response;
+  uint64_t user_data;
+  /// Why the request failed; `NoError` when `response` is set.
+  HttpErrorKind error_kind;
+};
+
+/// Bytes inside a block such as `ResponseMeta`; not NUL-terminated.
+struct ByteSpan {
+  const uint8_t *data;
+  uintptr_t len;
+};
+
+struct HeaderSpan {
+  ByteSpan name;
+  ByteSpan value;
+};
+
+/// Status line, addresses and headers of a response in one block: this
+/// struct, then the header array, then the bytes the spans point to.
+struct ResponseMeta {
+  int32_t status;
+  HttpVersion version;
+  ByteSpan url;
+  /// Empty when the connection didn't report one.
+  ByteSpan remote_addr;
+  /// In received order; a repeated header appears once per value.
+  const HeaderSpan *headers;
+  uintptr_t header_count;
+};
+
+/// What changes between instances of a `RequestTemplate`. Null or empty
+/// fields keep the template's value; all zeroes is the template unchanged.
+struct TemplateArgs {
+  /// Replaces the URL path, e.g. "/users/42", percent-encoded as needed.
+  const char *path;
+  /// Appended to the template's query string.
+  const Pair *query;
+  uintptr_t query_len;
+  /// Replace the template's values for these names.
+  const Pair *headers;
+  uintptr_t headers_len;
+  /// Replaces the body; copied.
+  const uint8_t *body;
+  uintptr_t body_len;
+};
+
+/// Everything `client_send_descriptor` needs for one request. Spans are
+/// read during the call only; nothing needs a NUL.
+struct RequestDescriptor {
+  /// An `HttpMethod`. Carried as an integer, as is `version`, so a value
+  /// outside the enum is an error rather than undefined behaviour.
+  uint32_t method;
+  ByteSpan url;
+  /// A repeated name is sent once per value.
+  const HeaderSpan *headers;
+  uintptr_t headers_len;
+  /// Appended to the URL's query string; `name` is the key.
+  const HeaderSpan *query;
+  uintptr_t query_len;
+  /// Copied. Null `data` sends no body.
+  ByteSpan body;
+  /// Milliseconds; null keeps the client's timeout.
+  const uint64_t *timeout;
+  /// An `HttpVersion`; null or `Unknown` lets the client negotiate.
+  const uint32_t *version;
+};
+
+/// Fill `buf` with up to `buf_len` bytes of a streamed request body.
+///
+/// Returns the number of bytes written, 0 at the end of the body and -1 to
+/// abort the request. Runs on a blocking pool thread, so it may block.
+using BodyReadCallback = int64_t(*)(void *user_data, uint8_t *buf, uintptr_t buf_len);
+
+/// Called on a runtime worker thread when `response_bytes_async` finishes.
+///
+/// `body` is null on failure; otherwise ownership passes to the callee, which
+/// must release it with `free_resp_body`.
+using BodyCallback = void(*)(void *user_data, void *body);
+
+/// Called on a runtime worker thread when `response_read_async` finishes,
+/// with the same `count` `response_read` would have returned.
+using ReadCallback = void(*)(void *user_data, int32_t count);
+
+/// Called once a request no longer needs a buffer passed to
+/// `request_builder_body_external`. May run on a runtime worker thread.
+using ReleaseCallback = void(*)(void *user_data);
+
+/// Called on a runtime worker thread when an async send finishes.
+///
+/// `response` is null on failure, in which case `take_last_http_error` on
+/// that same thread returns the reason. Ownership of a non-null `response`
+/// passes to the callee, which must release it with `response_destroy`.
+using ResponseCallback = void(*)(void *user_data, void *response);
+
+/// Receives body chunks from `response_stream_to`, on the calling thread.
+///
+/// `data` is only valid during the call. Return `false` to stop the
+/// transfer.
+using SinkCallback = bool(*)(void *user_data, const uint8_t *data, uintptr_t len);
+
 extern "C" {
 
+/// Fill `stats` with the pool counters.
+bool body_pool_stats(BodyPoolStats *stats);
+
 /// Add a custom root certificate.
 ///
 /// This allows connecting to a server that has a self-signed
@@ -197,6 +426,12 @@ extern "C" {
 /// trusted store.
 void *client_builder_add_root_certificate(void *handle, const char *cert_path);
 
+/// Set the limits of the pool response bodies are read into.
+///
+/// The pool is shared by every client in the process, so the limits of the
+/// client built last apply. All zeroes turns pooling off.
+void *client_builder_body_pool(void *handle, const BodyPoolLimits *limits);
+
 /// Returns a `Client` that uses this `ClientBuilder` configuration.
 ///
 /// # Errors
@@ -427,8 +662,32 @@ void *client_builder_user_agent(void *handle, const char *value);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_delete(void *handle, const char *url);
 
+/// Same as `client_delete` with a `len` byte URL, which needs no NUL.
+void *client_delete_len(void *handle, const uint8_t *url, uintptr_t len);
+
 void client_destroy(void *handle);
 
+/// Download `url` to the file at `path`, split into `segment_size` range
+/// requests of which `connections` run at once, each written in place.
+///
+/// A HEAD request finds the size first; servers without range support get
+/// a single plain GET instead. `options` may be null for defaults; `stats`
+/// may be null. Returns `false` on failure, which leaves a partial file and,
+/// with `resume`, the state to continue from.
+bool client_download(void *handle,
+                     const char *url,
+                     const char *path,
+                     const DownloadOptions *options,
+                     DownloadStats *stats);
+
+/// Same as `client_download`, with a wide-character path.
+bool client_download_wide(void *handle,
+                          const char *url,
+                          const wchar_t *path,
+                          uintptr_t length,
+                          const DownloadOptions *options,
+                          DownloadStats *stats);
+
 /// Executes a `Request`.
 ///
 /// A `Request` can be built manually with `Request::new()` or obtained
@@ -443,6 +702,21 @@ void client_destroy(void *handle);
 /// or redirect limit was exhausted.
 void *client_execute(void *handle, void *request);
 
+/// Executes `len` requests concurrently, at most `max_in_flight` at a time
+/// (0 means no limit), and blocks until all of them have finished.
+///
+/// Every `Request` in `requests` is consumed. `responses` must have room for
+/// `len` handles; `responses[i]` receives the `Response` for `requests[i]`,
+/// or null if that request failed, in which case the last error describes
+/// the most recent failure.
+///
+/// Returns `false` only if the batch itself could not be run.
+bool client_execute_batch(void *handle,
+                          void *const *requests,
+                          uintptr_t len,
+                          uintptr_t max_in_flight,
+                          void **responses);
+
 /// Convenience method to make a `GET` request to a URL.
 ///
 /// # Errors
@@ -450,6 +724,9 @@ void *client_execute(void *handle, void *request);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_get(void *handle, const char *url);
 
+/// Same as `client_get` with a `len` byte URL, which needs no NUL.
+void *client_get_len(void *handle, const uint8_t *url, uintptr_t len);
+
 /// Convenience method to make a `HEAD` request to a URL.
 ///
 /// # Errors
@@ -457,6 +734,9 @@ void *client_get(void *handle, const char *url);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_head(void *handle, const char *url);
 
+/// Same as `client_head` with a `len` byte URL, which needs no NUL.
+void *client_head_len(void *handle, const uint8_t *url, uintptr_t len);
+
 /// Convenience method to make a `PATCH` request to a URL.
 ///
 /// # Errors
@@ -464,6 +744,9 @@ void *client_head(void *handle, const char *url);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_patch(void *handle, const char *url);
 
+/// Same as `client_patch` with a `len` byte URL, which needs no NUL.
+void *client_patch_len(void *handle, const uint8_t *url, uintptr_t len);
+
 /// Convenience method to make a `POST` request to a URL.
 ///
 /// # Errors
@@ -471,6 +754,9 @@ void *client_patch(void *handle, const char *url);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_post(void *handle, const char *url);
 
+/// Same as `client_post` with a `len` byte URL, which needs no NUL.
+void *client_post_len(void *handle, const uint8_t *url, uintptr_t len);
+
 /// Convenience method to make a `PUT` request to a URL.
 ///
 /// # Errors
@@ -478,6 +764,9 @@ void *client_post(void *handle, const char *url);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_put(void *handle, const char *url);
 
+/// Same as `client_put` with a `len` byte URL, which needs no NUL.
+void *client_put_len(void *handle, const uint8_t *url, uintptr_t len);
+
 /// Start building a `Request` with the `Method` and `Url`.
 ///
 /// Returns a `RequestBuilder`, which will allow setting headers and
@@ -488,10 +777,27 @@ void *client_put(void *handle, const char *url);
 /// This method fails whenever supplied `Url` cannot be parsed.
 void *client_request(void *handle, const char *method, const char *url);
 
+/// Same as `client_request` with lengths, so neither string needs a NUL.
+void *client_request_len(void *handle,
+                         const uint8_t *method,
+                         uintptr_t method_len,
+                         const uint8_t *url,
+                         uintptr_t url_len);
+
+/// Build the request `desc` describes and send it, all in one call. The
+/// client's default headers are added as for any other request.
+///
+/// Returns null on failure.
+void *client_send_descriptor(void *handle, const RequestDescriptor *desc);
+
+void free_header_spans(HeaderSpan *spans);
+
 void free_r_string(void *handle);
 
 void free_resp_body(void *handle);
 
+void free_response_meta(ResponseMeta *meta);
+
 /// Inserts a key-value pair into the map.
 ///
 /// If the map did not previously have this key present, then `false` is
@@ -503,6 +809,18 @@ void free_resp_body(void *handle);
 /// identical.
 bool header_map_append(void *handle, const char *key, const char *value);
 
+/// `header_map_append` with an interned name and value, which are only
+/// cloned.
+bool header_map_append_interned(void *handle, const void *name, const void *value);
+
+/// Same as `header_map_append` with `key_len` and `value_len` bytes, which
+/// need no NUL. Both are validated as bytes, without a UTF-8 check.
+bool header_map_append_len(void *handle,
+                           const uint8_t *key,
+                           uintptr_t key_len,
+                           const uint8_t *value,
+                           uintptr_t value_len);
+
 /// Returns the number of headers the map can hold without reallocating.
 ///
 /// This number is an approximation as certain usage patterns could cause
@@ -519,8 +837,23 @@ void header_map_clear(void *handle);
 /// If only return false,can't show function failed or isn't contains.
 bool header_map_contains_key(void *handle, const char *key);
 
+/// Same as `header_map_contains_key` with a `key_len` byte key, which
+/// needs no NUL.
+bool header_map_contains_key_len(void *handle, const uint8_t *key, uintptr_t key_len);
+
 void header_map_destroy(void *handle);
 
+/// Every entry of the map as a (name, value bytes) span, in one block: the
+/// `count` spans followed by the bytes they point to. A key with several
+/// values appears once per value, and values are exact, not made visible.
+///
+/// The block is a copy, unaffected by later changes to the map. Release it
+/// with `free_header_spans`. Returns null on failure.
+HeaderSpan *header_map_entries(void *handle, uintptr_t *count);
+
+/// Same as `header_map_entries`, in memory from `allocator`, which owns it.
+HeaderSpan *header_map_entries_into(void *handle, const Allocator *allocator, uintptr_t *count);
+
 ///Don't forget free
 void *header_map_get(void *handle, const char *key);
 
@@ -531,6 +864,9 @@ void *header_map_get(void *handle, const char *key);
 /// Returns `None` if there are no values associated with the key.
 void *header_map_get_all(void *handle, const char *key);
 
+/// Same as `header_map_get` with a `key_len` byte key, which needs no NUL.
+void *header_map_get_len(void *handle, const uint8_t *key, uintptr_t key_len);
+
 /// Inserts a key-value pair into the map.
 ///
 /// If the map did not previously have this key present, then `None` is
@@ -547,6 +883,26 @@ void *header_map_get_all(void *handle, const char *key);
 /// without being identical.
 bool header_map_insert(void *handle, const char *key, const char *value);
 
+/// `header_map_insert` with an interned name and value, which are only
+/// cloned.
+bool header_map_insert_interned(void *handle, const void *name, const void *value);
+
+/// Same as `header_map_insert` with `key_len` and `value_len` bytes, which
+/// need no NUL. Both are validated as bytes, without a UTF-8 check.
+bool header_map_insert_len(void *handle,
+                           const uint8_t *key,
+                           uintptr_t key_len,
+                           const uint8_t *value,
+                           uintptr_t value_len);
+
+/// Validate and insert `len` pairs in one call. Names already in the map
+/// lose their old values; a name repeated in `pairs` keeps all of its own.
+///
+/// The map is untouched and `false` is returned if any pair is invalid.
+bool header_map_insert_many(void *handle, const Pair *pairs, uintptr_t len);
+
+/// Keys joined with `;`. Use `header_map_entries` to walk the map without
+/// re-parsing.
 void *header_map_keys(void *handle);
 
 /// Returns the number of keys stored in the map.
@@ -571,6 +927,9 @@ int32_t header_map_len(void *handle);
 /// values.
 bool header_map_remove(void *handle, const char *key);
 
+/// Same as `header_map_remove` with a `key_len` byte key, which needs no NUL.
+bool header_map_remove_len(void *handle, const uint8_t *key, uintptr_t key_len);
+
 /// Reserves capacity for at least `additional` more headers to be inserted
 /// into the `HeaderMap`.
 ///
@@ -581,8 +940,35 @@ bool header_map_remove(void *handle, const char *key);
 /// reached.
 void header_map_reserve(void *handle, uint32_t additional);
 
+/// Values in Debug format, with non-visible ones as "opaque". Use
+/// `header_map_entries` to get the exact bytes.
 void *header_map_values(void *handle);
 
+void header_name_destroy(void *handle);
+
+/// Validate a header name once, for reuse by the `_interned` functions
+/// without parsing it again. Names are lowercased. Release it with
+/// `header_name_destroy`; it may be shared by threads until then.
+///
+/// Returns null if `name` is not a valid header name.
+void *header_name_new(const char *name);
+
+/// Same as `header_name_new` with `len` bytes, which need no NUL.
+void *header_name_new_len(const uint8_t *name, uintptr_t len);
+
+void header_value_destroy(void *handle);
+
+/// Like `header_value_new` without the copy: the value refers to `data`,
+/// which must stay unchanged for the rest of the process, such as a string
+/// literal.
+void *header_value_from_static(const uint8_t *data, uintptr_t len);
+
+/// Validate `len` bytes as a header value once, copying them, for reuse by
+/// the `_interned` functions. Release it with `header_value_destroy`.
+///
+/// Returns null if the bytes are not a valid header value.
+void *header_value_new(const uint8_t *data, uintptr_t len);
+
 void http_err_clear(void *handle);
 
 void http_err_destroy(void *handle);
@@ -599,6 +985,50 @@ uint64_t http_err_msg_len(void *handle);
 /// times as you want and logging will only be initialized the first time.
 void initialize_logging();
 
+bool json_writer_begin_array(void *handle);
+
+bool json_writer_begin_object(void *handle);
+
+bool json_writer_bool(void *handle, bool value);
+
+/// Releases a writer. A streamed document that wasn't finished aborts its
+/// request rather than sending a truncated body.
+void json_writer_destroy(void *handle);
+
+/// Fails for NaN and infinities, which JSON can't represent.
+bool json_writer_double(void *handle, double value);
+
+bool json_writer_end_array(void *handle);
+
+bool json_writer_end_object(void *handle);
+
+/// End a document started with `request_builder_json_stream` and wait for
+/// the response. The writer is consumed.
+///
+/// Returns null if the request failed or the document is incomplete, in
+/// which case the upload was aborted.
+void *json_writer_finish(void *handle);
+
+bool json_writer_integer(void *handle, int64_t value);
+
+/// The key of the next object member; `len` UTF-8 bytes, escaped here.
+bool json_writer_key(void *handle, const uint8_t *key, uintptr_t len);
+
+/// A writer that keeps the whole document, for `request_builder_json_writer`.
+///
+/// Every call appends in place and returns `false` on misuse (a value in an
+/// object without a key, an unbalanced end, a second top-level value). The
+/// writer then stays failed.
+void *json_writer_new();
+
+bool json_writer_null(void *handle);
+
+/// A value already serialized as JSON, copied in without being checked.
+bool json_writer_raw(void *handle, const uint8_t *value, uintptr_t len);
+
+/// A string of `len` UTF-8 bytes, escaped here.
+bool json_writer_string(void *handle, const uint8_t *value, uintptr_t len);
+
 /// Constructs a new `ClientBuilder`.
 void *new_client_builder();
 
@@ -624,17 +1054,53 @@ void *request_builder_basic_auth(void *handle,
                                            const char *username,
                                            const char *password);
 
+/// Same as `request_builder_basic_auth` with lengths, so neither string
+/// needs a NUL. A null `password` sends none.
+void *request_builder_basic_auth_len(void *handle,
+                                     const uint8_t *username,
+                                     uintptr_t username_len,
+                                     const uint8_t *password,
+                                     uintptr_t password_len);
+
 /// Enable HTTP bearer authentication.
 void *request_builder_bearer_auth(void *handle, const char *token);
 
+/// Same as `request_builder_bearer_auth` with a `token_len` byte token,
+/// which needs no NUL.
+void *request_builder_bearer_auth_len(void *handle, const uint8_t *token, uintptr_t token_len);
+
 /// Set the request body from u8 array.
 void *request_builder_body_bytes(void *handle,
                                            const uint8_t *bytes,
                                            uintptr_t size);
 
+/// Set the request body from `len` bytes at `data` without copying them.
+///
+/// The memory must stay valid and unchanged until `release(user_data)` is
+/// called, which happens exactly once when the body is no longer needed,
+/// possibly on a runtime worker thread. `release` may be null. If this call
+/// fails, `release` is called before it returns.
+void *request_builder_body_external(void *handle,
+                                    const uint8_t *data,
+                                    uintptr_t len,
+                                    ReleaseCallback release,
+                                    void *user_data);
+
 /// Set the request body from file.
 void *request_builder_body_file(void *handle, const char *file_path);
 
+/// Set the request body from a memory-mapped file, sent without copying it
+/// through userspace buffers. Falls back to `request_builder_body_file` for
+/// pipes and other files that can't be mapped.
+///
+/// The file must not be truncated while the request is in flight.
+void *request_builder_body_file_mapped(void *handle, const char *file_path);
+
+/// Same as `request_builder_body_file_mapped`, with a wide-character path.
+void *request_builder_body_file_mapped_wide(void *handle,
+                                            const wchar_t *file_path,
+                                            uintptr_t length);
+
 /// Set the request body from file.
 void *request_builder_body_file_wide(void *handle,
                                                const wchar_t *file_path,
@@ -651,6 +1117,19 @@ void *request_builder_body_file_with_name_wide(void *handle,
                                                          const wchar_t *file_path,
                                                          uintptr_t path_len);
 
+/// Stream the request body from `read`, pulled chunk by chunk as the
+/// connection accepts data.
+///
+/// `length` (nullable) sets `Content-Length`; without it the body is sent
+/// with chunked encoding. `release(user_data)` is called exactly once when
+/// the reader is no longer needed, including when this call fails; it may be
+/// null.
+void *request_builder_body_stream(void *handle,
+                                  BodyReadCallback read,
+                                  ReleaseCallback release,
+                                  void *user_data,
+                                  const uint64_t *length);
+
 /// Set the request body from UTF-8 text.
 void *request_builder_body_string(void *handle, const char *str);
 
@@ -665,11 +1144,46 @@ void request_builder_destroy(void *handle);
 /// Sets the body to the url encoded serialization of the passed value,
 /// and also sets the `Content-Type: application/x-www-form-urlencoded`
 /// header.
+///
+/// The pairs are serialized in place; null is returned if any key or
+/// value is null or not UTF-8.
 void *request_builder_form(void *handle, const Pair *pairs, uintptr_t len);
 
 /// Add a `Header` to this Request.
 void *request_builder_header(void *handle, const char *key, const char *value);
 
+/// Add a `Header` from an interned name and value, which are only cloned,
+/// not parsed again.
+void *request_builder_header_interned(void *handle, const void *name, const void *value);
+
+/// Same as `request_builder_header` with `key_len` and `value_len` bytes,
+/// which need no NUL. Both are validated as bytes, without a UTF-8 check;
+/// like `request_builder_header`, an invalid header fails the send.
+void *request_builder_header_len(void *handle,
+                                 const uint8_t *key,
+                                 uintptr_t key_len,
+                                 const uint8_t *value,
+                                 uintptr_t value_len);
+
+/// Add a `Header` from an interned name and a value that changes per
+/// request, such as a request id. The value is validated as bytes, without
+/// a UTF-8 check.
+void *request_builder_header_named(void *handle, const void *name, const char *value);
+
+/// Same as `request_builder_header_named` with a `value_len` byte value,
+/// which needs no NUL.
+void *request_builder_header_named_len(void *handle,
+                                       const void *name,
+                                       const uint8_t *value,
+                                       uintptr_t value_len);
+
+/// Add `len` headers given as pairs, validated together in one call.
+///
+/// Like `request_builder_headers`, a name set earlier on this builder loses
+/// its old values; a name repeated in `pairs` keeps all of its own. Nothing
+/// is added and null is returned if any pair is invalid.
+void *request_builder_header_pairs(void *handle, const Pair *pairs, uintptr_t len);
+
 /// Add a `Header` to this Request.
 void *request_builder_headers(void *handle, void *headers);
 
@@ -677,8 +1191,27 @@ void *request_builder_headers(void *handle, void *headers);
 ///
 /// Sets the body to the JSON serialization of the passed value, and
 /// also sets the `Content-Type: application/json` header.
+///
+/// The pairs are serialized in place; null is returned if any key or
+/// value is null or not UTF-8.
 void *request_builder_json(void *handle, const Pair *pairs, uintptr_t len);
 
+/// Send the request now with a JSON body written through the returned
+/// writer while it is in flight. Chunks of about 64 KiB go out with chunked
+/// encoding as they fill, so a document of any size needs only a few of
+/// them in memory; writing blocks while the connection catches up.
+///
+/// Consumes the builder, replacing any body it had. Finish with
+/// `json_writer_finish` for the response. Must not be called on a runtime
+/// worker thread.
+void *request_builder_json_stream(void *handle);
+
+/// Use the complete document of `writer` as the body, with
+/// `Content-Type: application/json`. The bytes are moved, not copied.
+///
+/// `writer` is consumed, even on failure.
+void *request_builder_json_writer(void *handle, void *writer);
+
 /// Modify the query string of the URL.
 ///
 /// Modifies the URL of this request, adding the parameters provided.
@@ -687,6 +1220,9 @@ void *request_builder_json(void *handle, const Pair *pairs, uintptr_t len);
 /// overwritten if the same key is used. The key will simply show up
 /// twice in the query string.
 /// Calling `.query(&[("foo", "a"), ("foo", "b")])` gives `"foo=a&foo=b"`.
+///
+/// The pairs are serialized in place; null is returned if any key or
+/// value is null or not UTF-8.
 void *request_builder_query(void *handle, const Pair *querys, uintptr_t len);
 
 /// Constructs the Request and sends it the target URL, returning a Response.
@@ -697,6 +1233,14 @@ void *request_builder_query(void *handle, const Pair *querys, uintptr_t len);
 /// redirect loop was detected or redirect limit was exhausted.
 void *request_builder_send(void *handle);
 
+/// Constructs the Request and sends it on the shared runtime without
+/// blocking the calling thread.
+///
+/// `callback` is invoked exactly once, on a runtime worker thread, with
+/// `user_data` and the `Response` (or null on failure). Returns `false` if
+/// the request could not be queued, in which case `callback` is never called.
+bool request_builder_send_async(void *handle, ResponseCallback callback, void *user_data);
+
 /// Enables a request timeout.
 ///
 /// The timeout is applied from when the request starts connecting until the
@@ -704,13 +1248,38 @@ void *request_builder_send(void *handle);
 /// the timeout configured using `ClientBuilder::timeout()`.
 void *request_builder_timeout(void *handle, uint64_t millisecond);
 
+/// A new builder with the same settings. `handle` is left as it was.
+///
+/// Returns null if the body is a stream, which can't be cloned.
 void *request_builder_try_clone(void *handle);
 
 /// Set HTTP version
 void *request_builder_version(void *handle, const char *version);
 
+/// Same as `request_builder_version` with a `version_len` byte version,
+/// which needs no NUL.
+void *request_builder_version_len(void *handle, const uint8_t *version, uintptr_t version_len);
+
 void request_destroy(void *handle);
 
+void request_template_destroy(void *handle);
+
+/// Turn a `RequestBuilder` into a template, consuming it.
+///
+/// Fails if the builder is invalid or its body is a stream, which can only
+/// be sent once.
+void *request_template_new(void *builder);
+
+/// A `Request` from the template with `args` applied, for
+/// `client_execute` or `client_execute_batch`. `args` may be null.
+void *request_template_request(const void *handle, const TemplateArgs *args);
+
+/// Instantiate the template with `args` and send it with the client of the
+/// builder it came from, in one call. `args` may be null.
+///
+/// The template is only read, so threads may share it.
+void *request_template_send(const void *handle, const TemplateArgs *args);
+
 const uint8_t *resp_body_content(void *handle);
 
 uint64_t resp_body_content_len(void *handle);
@@ -740,6 +1309,21 @@ void *response_body_text_with_charset(void *handle,
 /// Don't forget free
 void *response_bytes(void *handle);
 
+/// Get the full response body without blocking the calling thread.
+///
+/// `callback` is invoked exactly once, on a runtime worker thread, with
+/// `user_data` and the body (or null on failure). Like `response_bytes` this
+/// consumes the body. Returns `false` if nothing was queued, in which case
+/// `callback` is never called.
+bool response_bytes_async(void *handle, BodyCallback callback, void *user_data);
+
+/// Read the whole body into memory from `allocator`, followed by a NUL that
+/// `len` doesn't count. This consumes the body.
+///
+/// The memory belongs to the allocator; nothing has to be freed through this
+/// library. Returns null on failure.
+uint8_t *response_bytes_into(void *handle, const Allocator *allocator, uintptr_t *len);
+
 /// Get the content-length of the response, if it is known.
 uint64_t response_content_length(void *handle);
 
@@ -759,17 +1343,85 @@ void response_destroy(void *handle);
 /// Get the `Headers` of this `Response`.
 void *response_headers(void *handle);
 
+/// Copy every header into one block from `allocator`: `count` `Pair`s of
+/// NUL-terminated names and values, followed by the strings themselves.
+/// Returns null on failure.
+Pair *response_headers_into(void *handle, const Allocator *allocator, uintptr_t *count);
+
+/// Status, version, URL, remote address and headers in one block, taken
+/// with a single call. Release it with `free_response_meta`.
+///
+/// Must be called before the body is consumed. Returns null on failure.
+ResponseMeta *response_meta(void *handle);
+
+/// Same as `response_meta`, in memory from `allocator`, which owns it.
+ResponseMeta *response_meta_into(void *handle, const Allocator *allocator);
+
+/// Read at most `buf_len` bytes of the body into `buf`.
+///
+/// Returns the number of bytes read, 0 once the body is exhausted and -1 on
+/// failure.
 int32_t response_read(void *handle, uint8_t *buf, uint32_t buf_len);
 
+/// Read at most `buf_len` bytes of the body into `buf` without blocking the
+/// calling thread.
+///
+/// `callback` is invoked exactly once, on a runtime worker thread, with
+/// `user_data` and the count `response_read` would have returned. `handle`
+/// and `buf` must stay valid and untouched until then. Returns `false` if
+/// nothing was queued, in which case `callback` is never called.
+bool response_read_async(void *handle,
+                         uint8_t *buf,
+                         uint32_t buf_len,
+                         ReadCallback callback,
+                         void *user_data);
+
 /// Get the remote address used to get this `Response`.
 void *response_remote_addr(void *handle);
 
+/// `response_remote_addr` as a NUL-terminated string from `allocator`.
+char *response_remote_addr_into(void *handle, const Allocator *allocator);
+
+/// Write the body straight to the file at `path`, replacing it, without
+/// passing it through the caller. This consumes the body.
+///
+/// `options` may be null for defaults; `stats` may be null. Returns `false`
+/// on failure, which may leave a partial file behind.
+bool response_save_to_file(void *handle,
+                           const char *path,
+                           const SaveOptions *options,
+                           SaveStats *stats);
+
+/// Same as `response_save_to_file`, with a wide-character path.
+bool response_save_to_file_wide(void *handle,
+                                const wchar_t *path,
+                                uintptr_t length,
+                                const SaveOptions *options,
+                                SaveStats *stats);
+
 /// Get the `StatusCode` of this `Response`.
 int32_t response_status(void *handle);
 
+/// Deliver the body to `sink` chunk by chunk as it arrives, without holding
+/// more than one chunk in memory.
+///
+/// Chunks smaller than `chunk_hint` bytes are merged until they reach it, to
+/// save calls for bodies that arrive in small pieces; 0 hands over every
+/// chunk as received. This consumes the body.
+///
+/// Returns the number of bytes delivered, or -1 if the transfer failed or
+/// `sink` returned `false`.
+int64_t response_stream_to(void *handle, SinkCallback sink, void *user_data, uintptr_t chunk_hint);
+
+/// Same as `response_bytes_into`, decoded like `response_body_text`.
+char *response_text_into(void *handle, const Allocator *allocator, uintptr_t *len);
+
 /// Get the final `Url` of this `Response`.
 void *response_url(void *handle);
 
+/// `response_url` as a NUL-terminated string from `allocator`.
+char *response_url_into(void *handle, const Allocator *allocator);
+
 /// Get the HTTP `Version` of this `Response`.
 /// Don't forget free string
 ///Version::HTTP_09 => "HTTP/0.9",
@@ -780,6 +1432,47 @@ void *response_url(void *handle);
 ///_ => "unreachable"
 void *response_version(void *handle);
 
+/// `response_version` as a NUL-terminated string from `allocator`.
+char *response_version_into(void *handle, const Allocator *allocator);
+
+/// Destroy the ring. Requests still in flight finish in the background and
+/// their responses are dropped; queued but unsubmitted requests are dropped.
+void ring_destroy(void *handle);
+
+/// The eventfd that becomes readable when completions are waiting, or -1 on
+/// platforms without eventfd.
+int32_t ring_eventfd(void *handle);
+
+/// Create a ring bound to `client` with room for `entries` submissions
+/// (rounded up to a power of two) and twice as many completions.
+void *ring_new(void *client, uint32_t entries);
+
+/// Queue `count` entries without starting them. Returns how many were
+/// accepted; the requests of the rest stay owned by the caller.
+uintptr_t ring_push(void *handle, const RingSqe *sqes, uintptr_t count);
+
+/// Move up to `max` completions into `cqes` without blocking. Returns the
+/// number written. Also re-arms the eventfd notification.
+uintptr_t ring_reap(void *handle, RingCqe *cqes, uintptr_t max);
+
+/// Start every queued request, as far as the completion queue has room for
+/// its result. Returns the number started.
+uintptr_t ring_submit(void *handle);
+
+/// Configure the shared runtime all clients run on.
+///
+/// `worker_threads` of 0 means one per core. With `pin_cores` each worker
+/// thread is pinned to its own CPU, round robin (Linux only, ignored
+/// elsewhere); threads started later for `spawn_blocking` or to stand in for
+/// a worker in `block_in_place` are not.
+///
+/// Must be called before the first client is built or request is sent;
+/// returns `false` if the runtime is already running or could not be built.
+bool runtime_init(uint32_t worker_threads, bool pin_cores);
+
+/// Number of worker threads of the shared runtime, starting it if needed.
+uint32_t runtime_worker_threads();
+
 void *take_last_http_error();
 
 }  // extern "C"
@@ -1,10 +1,21 @@
 #include "header_map.h"
 
 #include "crab_http_c.h"
+#include "header_name.h"
+#include "header_value.h"
 #include "r_string.h"
 
 namespace crab::http
 {
+HeaderEntries::HeaderEntries(HeaderSpan *spans, size_t count) : spans_(spans), count_(count)
+{
+}
+
+HeaderEntries::~HeaderEntries()
+{
+    free_header_spans(spans_);
+}
+
 HeaderMap::HeaderMap(void *handle) : handle_(handle)
 {
 }
@@ -29,14 +40,29 @@ HeaderMap::uptr HeaderMap::Build(void *handle)
     return Create(handle);
 }
 
-bool HeaderMap::insert(const std::string &key, const std::string &value)
+bool HeaderMap::insert(std::string_view key, std::string_view value)
 {
-    return header_map_insert(handle_, key.c_str(), value.c_str());
+    return header_map_insert_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size(), reinterpret_cast<const uint8_t *>(value.data()), value.size());
 }
 
-bool HeaderMap::append(const std::string &key, const std::string &value)
+bool HeaderMap::insert(const HeaderName &name, const HeaderValue &value)
 {
-    return header_map_append(handle_, key.c_str(), value.c_str());
+    return header_map_insert_interned(handle_, name.handle_, value.handle_);
+}
+
+bool HeaderMap::insert_many(const Pair *pairs, size_t len)
+{
+    return header_map_insert_many(handle_, pairs, len);
+}
+
+bool HeaderMap::append(std::string_view key, std::string_view value)
+{
+    return header_map_append_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size(), reinterpret_cast<const uint8_t *>(value.data()), value.size());
+}
+
+bool HeaderMap::append(const HeaderName &name, const HeaderValue &value)
+{
+    return header_map_append_interned(handle_, name.handle_, value.handle_);
 }
 
 uintptr_t HeaderMap::capacity() const
@@ -49,15 +75,26 @@ void HeaderMap::clear()
     header_map_clear(handle_);
 }
 
-bool HeaderMap::contains_key(const std::string &key)
+bool HeaderMap::contains_key(std::string_view key)
 {
-    bool ret = header_map_contains_key(handle_, key.c_str());
+    bool ret = header_map_contains_key_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size());
     return ret;
 }
 
-std::unique_ptr<RString> HeaderMap::get(const std::string &key) const
+std::unique_ptr<HeaderEntries> HeaderMap::entries() const
+{
+    uintptr_t count = 0;
+    auto spans = header_map_entries(handle_, &count);
+    if (!spans)
+    {
+        return nullptr;
+    }
+    return HeaderEntries::Create(spans, count);
+}
+
+std::unique_ptr<RString> HeaderMap::get(std::string_view key) const
 {
-    void *v = header_map_get(handle_, key.c_str());
+    void *v = header_map_get_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size());
     return RString::Build(v);
 }
 
@@ -89,9 +126,9 @@ uintptr_t HeaderMap::len() const
     return header_map_len(handle_);
 }
 
-bool HeaderMap::remove(std::string &key)
+bool HeaderMap::remove(std::string_view key)
 {
-    return header_map_remove(handle_, key.c_str());
+    return header_map_remove_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size());
 }
 
 void HeaderMap::reserve(uint32_t additional)
@@ -3,13 +3,85 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+
+#include "crab_http_c.h"
 
 namespace crab::http
 {
 class RString;
+class HeaderName;
+class HeaderValue;
 class ClientBuilder;
 class RequestBuilder;
 
+inline std::string_view View(const ByteSpan &span)
+{
+    return std::string_view(reinterpret_cast<const char *>(span.data), span.len);
+}
+
+/// The reverse of `View()`, for filling a `RequestDescriptor`. Borrows `str`.
+inline ByteSpan Span(std::string_view str)
+{
+    return ByteSpan{reinterpret_cast<const uint8_t *>(str.data()), str.size()};
+}
+
+/// Copy of every entry of a `HeaderMap` in one block, iterated as
+/// `HeaderSpan`s whose names and exact value bytes are read with `View()`.
+/// A key with several values appears once per value.
+class HeaderEntries
+{
+    friend class HeaderMap;
+
+  private:
+    template <typename... Args> static std::unique_ptr<HeaderEntries> Create(Args &&...args)
+    {
+        struct make_unique_helper : public HeaderEntries
+        {
+            explicit make_unique_helper(Args &&...a) : HeaderEntries(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    HeaderEntries(HeaderSpan *spans, size_t count);
+
+  public:
+    HeaderEntries() = delete;
+
+    HeaderEntries(const HeaderEntries &) = delete;
+
+    HeaderEntries(HeaderEntries &&) = delete;
+
+    HeaderEntries &operator=(const HeaderEntries &) = delete;
+
+    HeaderEntries &operator=(HeaderEntries &&) = delete;
+
+    ~HeaderEntries();
+
+  public:
+    const HeaderSpan *begin() const
+    {
+        return spans_;
+    }
+
+    const HeaderSpan *end() const
+    {
+        return spans_ + count_;
+    }
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+  private:
+    HeaderSpan *spans_{nullptr};
+    size_t count_{0};
+};
+
 class HeaderMap
 {
     friend class ClientBuilder;
@@ -52,7 +124,16 @@ class HeaderMap
 
     static uptr Build(void *handle);
 
-    bool insert(const std::string &key, const std::string &value);
+    bool insert(std::string_view key, std::string_view value);
+
+    /// `insert()` with handles validated once, so nothing is parsed here.
+    bool insert(const HeaderName &name, const HeaderValue &value);
+
+    /// Validate and insert `len` pairs in one call. Names already in the map
+    /// lose their old values; a name repeated in `pairs` keeps all of its own.
+    ///
+    /// The map is untouched and `false` is returned if any pair is invalid.
+    bool insert_many(const Pair *pairs, size_t len);
 
     /// Inserts a key-value pair into the map.
     ///
@@ -63,7 +144,9 @@ class HeaderMap
     /// of the list of values currently associated with the key. The key is not
     /// updated, though; this matters for types that can be `==` without being
     /// identical.
-    bool append(const std::string &key, const std::string &value);
+    bool append(std::string_view key, std::string_view value);
+
+    bool append(const HeaderName &name, const HeaderValue &value);
 
     /// Returns the number of headers the map can hold without reallocating.
     ///
@@ -79,9 +162,13 @@ class HeaderMap
     /// Return -1 if function failed.
     /// why not use bool? because bk is bool.
     /// If only return false,can't show function failed or isn't contains.
-    bool contains_key(const std::string &key);
+    bool contains_key(std::string_view key);
+
+    /// Every entry as (name, value bytes), without the string joining of
+    /// `keys()` and `values()`. nullptr on failure.
+    std::unique_ptr<HeaderEntries> entries() const;
 
-    std::unique_ptr<RString> get(const std::string &key) const;
+    std::unique_ptr<RString> get(std::string_view key) const;
 
     /// Returns a view of all values associated with a key.
     ///
@@ -112,7 +199,7 @@ class HeaderMap
     /// multiple values associated with the key, then the first one is returned.
     /// See `remove_entry_mult` on `OccupiedEntry` for an API that yields all
     /// values.
-    bool remove(std::string &key);
+    bool remove(std::string_view key);
 
     /// Reserves capacity for at least `additional` more headers to be inserted
     /// into the `HeaderMap`.
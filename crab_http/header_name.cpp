@@ -0,0 +1,25 @@
+#include "header_name.h"
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+HeaderName::HeaderName(void *handle) : handle_(handle)
+{
+}
+
+HeaderName::~HeaderName()
+{
+    header_name_destroy(handle_);
+}
+
+HeaderName::uptr HeaderName::intern(std::string_view name)
+{
+    auto handle = header_name_new_len(reinterpret_cast<const uint8_t *>(name.data()), name.size());
+    if (!handle)
+    {
+        return nullptr;
+    }
+    return Create(handle);
+}
+} // namespace crab::http
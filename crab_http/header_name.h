@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace crab::http
+{
+class HeaderMap;
+class RequestBuilder;
+
+/// Header name parsed once and reused across requests, instead of on every
+/// call taking a `std::string` key.
+class HeaderName
+{
+    friend class HeaderMap;
+
+    friend class RequestBuilder;
+
+  public:
+    using uptr = std::unique_ptr<HeaderName>;
+
+  private:
+    template <typename... Args> static std::unique_ptr<HeaderName> Create(Args &&...args)
+    {
+        struct make_unique_helper : public HeaderName
+        {
+            explicit make_unique_helper(Args &&...a) : HeaderName(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    explicit HeaderName(void *handle);
+
+  public:
+    HeaderName() = delete;
+
+    HeaderName(const HeaderName &) = delete;
+
+    HeaderName(HeaderName &&) = delete;
+
+    HeaderName &operator=(const HeaderName &) = delete;
+
+    HeaderName &operator=(HeaderName &&) = delete;
+
+    ~HeaderName();
+
+  public:
+    /// Validate `name` once. Names are lowercased. nullptr if it is not a
+    /// valid header name. The handle may be shared by threads.
+    static uptr intern(std::string_view name);
+
+  private:
+    void *handle_{nullptr};
+};
+} // namespace crab::http
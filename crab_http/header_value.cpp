@@ -0,0 +1,30 @@
+#include "header_value.h"
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+HeaderValue::HeaderValue(void *handle) : handle_(handle)
+{
+}
+
+HeaderValue::~HeaderValue()
+{
+    header_value_destroy(handle_);
+}
+
+HeaderValue::uptr HeaderValue::from_static(std::string_view value)
+{
+    return from_bytes(value);
+}
+
+HeaderValue::uptr HeaderValue::from_bytes(std::string_view value)
+{
+    auto handle = header_value_new(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+    if (!handle)
+    {
+        return nullptr;
+    }
+    return Create(handle);
+}
+} // namespace crab::http
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+namespace crab::http
+{
+class HeaderMap;
+class RequestBuilder;
+
+/// Header value checked once; attaching it to a request or map afterwards
+/// only takes a reference count.
+class HeaderValue
+{
+    friend class HeaderMap;
+
+    friend class RequestBuilder;
+
+  public:
+    using uptr = std::unique_ptr<HeaderValue>;
+
+  private:
+    template <typename... Args> static std::unique_ptr<HeaderValue> Create(Args &&...args)
+    {
+        struct make_unique_helper : public HeaderValue
+        {
+            explicit make_unique_helper(Args &&...a) : HeaderValue(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    explicit HeaderValue(void *handle);
+
+  public:
+    HeaderValue() = delete;
+
+    HeaderValue(const HeaderValue &) = delete;
+
+    HeaderValue(HeaderValue &&) = delete;
+
+    HeaderValue &operator=(const HeaderValue &) = delete;
+
+    HeaderValue &operator=(HeaderValue &&) = delete;
+
+    ~HeaderValue();
+
+  public:
+    /// Validate a constant such as a string literal once. The bytes are
+    /// copied like `from_bytes`, as C++ can't tell a literal from any other
+    /// array; C callers that can vouch for the storage have the zero-copy
+    /// `header_value_from_static`. nullptr if it is not a valid header value.
+    static uptr from_static(std::string_view value);
+
+    /// Validate a copy of `value` once. nullptr if it is not a valid header
+    /// value.
+    static uptr from_bytes(std::string_view value);
+
+  private:
+    void *handle_{nullptr};
+};
+} // namespace crab::http
@@ -0,0 +1,119 @@
+#include "json_writer.h"
+
+#include "crab_http_c.h"
+#include "response.h"
+
+namespace crab::http
+{
+JsonWriter::JsonWriter(void *handle) : handle_(handle)
+{
+}
+
+JsonWriter::~JsonWriter()
+{
+    json_writer_destroy(handle_);
+}
+
+JsonWriter::uptr JsonWriter::Build(void *handle)
+{
+    return Create(handle);
+}
+
+JsonWriter::uptr JsonWriter::Build()
+{
+    return Create(json_writer_new());
+}
+
+void JsonWriter::call(bool ok)
+{
+    ok_ = ok_ && ok;
+}
+
+JsonWriter *JsonWriter::begin_object()
+{
+    call(json_writer_begin_object(handle_));
+    return this;
+}
+
+JsonWriter *JsonWriter::end_object()
+{
+    call(json_writer_end_object(handle_));
+    return this;
+}
+
+JsonWriter *JsonWriter::begin_array()
+{
+    call(json_writer_begin_array(handle_));
+    return this;
+}
+
+JsonWriter *JsonWriter::end_array()
+{
+    call(json_writer_end_array(handle_));
+    return this;
+}
+
+JsonWriter *JsonWriter::key(std::string_view key)
+{
+    call(json_writer_key(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size()));
+    return this;
+}
+
+JsonWriter *JsonWriter::string(std::string_view value)
+{
+    call(json_writer_string(handle_, reinterpret_cast<const uint8_t *>(value.data()), value.size()));
+    return this;
+}
+
+JsonWriter *JsonWriter::integer(int64_t value)
+{
+    call(json_writer_integer(handle_, value));
+    return this;
+}
+
+JsonWriter *JsonWriter::number(double value)
+{
+    call(json_writer_double(handle_, value));
+    return this;
+}
+
+JsonWriter *JsonWriter::boolean(bool value)
+{
+    call(json_writer_bool(handle_, value));
+    return this;
+}
+
+JsonWriter *JsonWriter::null()
+{
+    call(json_writer_null(handle_));
+    return this;
+}
+
+JsonWriter *JsonWriter::raw(std::string_view value)
+{
+    call(json_writer_raw(handle_, reinterpret_cast<const uint8_t *>(value.data()), value.size()));
+    return this;
+}
+
+bool JsonWriter::ok() const
+{
+    return ok_;
+}
+
+std::unique_ptr<Response> JsonWriter::finish()
+{
+    if (!handle_)
+    {
+        return nullptr;
+    }
+
+    auto resp = json_writer_finish(handle_);
+    handle_ = nullptr;
+
+    if (!resp)
+    {
+        return nullptr;
+    }
+    return Response::Build(resp);
+}
+} // namespace crab::http
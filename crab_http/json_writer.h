@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace crab::http
+{
+class RequestBuilder;
+class Response;
+
+/// JSON written value by value into a request body on the Rust side, either
+/// kept whole for `RequestBuilder::json(std::unique_ptr<JsonWriter>)` or
+/// streamed out in chunks from `RequestBuilder::json_stream()`.
+///
+/// Misuse (a value in an object without a key, an unbalanced end, a second
+/// top-level value) fails the writer for good; check `ok()`.
+class JsonWriter
+{
+    friend class RequestBuilder;
+
+  public:
+    using uptr = std::unique_ptr<JsonWriter>;
+
+  private:
+    template <typename... Args> static std::unique_ptr<JsonWriter> Create(Args &&...args)
+    {
+        struct make_unique_helper : public JsonWriter
+        {
+            explicit make_unique_helper(Args &&...a) : JsonWriter(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    static uptr Build(void *handle);
+
+    explicit JsonWriter(void *handle);
+
+  public:
+    /// A writer that keeps the whole document.
+    static uptr Build();
+
+    JsonWriter() = delete;
+
+    JsonWriter(const JsonWriter &) = delete;
+
+    JsonWriter(JsonWriter &&) = delete;
+
+    JsonWriter &operator=(const JsonWriter &) = delete;
+
+    JsonWriter &operator=(JsonWriter &&) = delete;
+
+    ~JsonWriter();
+
+  public:
+    JsonWriter *begin_object();
+
+    JsonWriter *end_object();
+
+    JsonWriter *begin_array();
+
+    JsonWriter *end_array();
+
+    /// The key of the next object member.
+    JsonWriter *key(std::string_view key);
+
+    JsonWriter *string(std::string_view value);
+
+    JsonWriter *integer(int64_t value);
+
+    /// NaN and infinities fail the writer.
+    JsonWriter *number(double value);
+
+    JsonWriter *boolean(bool value);
+
+    JsonWriter *null();
+
+    /// A value already serialized as JSON, copied in without being checked.
+    JsonWriter *raw(std::string_view value);
+
+    /// false once a call has failed.
+    bool ok() const;
+
+    /// End a document from `RequestBuilder::json_stream()` and wait for the
+    /// response. nullptr if the document is incomplete or the request failed.
+    std::unique_ptr<Response> finish();
+
+  private:
+    void call(bool ok);
+
+  private:
+    void *handle_{nullptr};
+
+    bool ok_{true};
+};
+} // namespace crab::http
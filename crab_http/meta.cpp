@@ -0,0 +1,51 @@
+#include "meta.h"
+
+namespace crab::http
+{
+namespace
+{
+bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+        if (x != y)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+Meta::Meta(ResponseMeta *meta) : meta_(meta)
+{
+}
+
+Meta::~Meta()
+{
+    free_response_meta(meta_);
+}
+
+std::unique_ptr<Meta> Meta::Build(ResponseMeta *meta)
+{
+    return Create(meta);
+}
+
+std::string_view Meta::get(std::string_view name) const
+{
+    for (const auto &header : *this)
+    {
+        if (EqualsIgnoreCase(View(header.name), name))
+        {
+            return View(header.value);
+        }
+    }
+    return {};
+}
+} // namespace crab::http
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+#include "crab_http_c.h"
+#include "header_map.h"
+
+namespace crab::http
+{
+class Response;
+
+/// Status, version, URL, remote address and headers of a `Response`, taken
+/// in one call into one block. Reading it allocates nothing; views stay
+/// valid as long as the `Meta`.
+class Meta
+{
+    friend class Response;
+
+  private:
+    template <typename... Args> static std::unique_ptr<Meta> Create(Args &&...args)
+    {
+        struct make_unique_helper : public Meta
+        {
+            explicit make_unique_helper(Args &&...a) : Meta(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    static std::unique_ptr<Meta> Build(ResponseMeta *meta);
+
+    explicit Meta(ResponseMeta *meta);
+
+  public:
+    Meta() = delete;
+
+    Meta(const Meta &) = delete;
+
+    Meta(Meta &&) = delete;
+
+    Meta &operator=(const Meta &) = delete;
+
+    Meta &operator=(Meta &&) = delete;
+
+    ~Meta();
+
+  public:
+    int32_t status() const
+    {
+        return meta_->status;
+    }
+
+    HttpVersion version() const
+    {
+        return meta_->version;
+    }
+
+    std::string_view url() const
+    {
+        return View(meta_->url);
+    }
+
+    /// Empty when the connection didn't report one.
+    std::string_view remote_addr() const
+    {
+        return View(meta_->remote_addr);
+    }
+
+    /// Headers in received order, a repeated one once per value, read with
+    /// `View()`. Names are lowercase.
+    const HeaderSpan *begin() const
+    {
+        return meta_->headers;
+    }
+
+    const HeaderSpan *end() const
+    {
+        return meta_->headers + meta_->header_count;
+    }
+
+    size_t size() const
+    {
+        return meta_->header_count;
+    }
+
+    /// First value of the header `name`, compared case-insensitively; an
+    /// empty view whose `data()` is null if there is none.
+    std::string_view get(std::string_view name) const;
+
+  private:
+    ResponseMeta *meta_{nullptr};
+};
+} // namespace crab::http
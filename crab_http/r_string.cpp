@@ -20,6 +20,11 @@ RString::uptr RString::Build(void *handle)
 }
 
 std::string RString::Chars() const
+{
+    return std::string(View());
+}
+
+std::string_view RString::View() const
 {
     if (CharsNonNul()) {
         return {CharsNonNul(), Length()};
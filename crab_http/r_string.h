@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace crab::http
 {
@@ -50,6 +51,10 @@ class RString
 
     [[nodiscard]] std::string Chars() const;
 
+    /// View of the string without copying it, valid as long as this
+    /// `RString` lives.
+    [[nodiscard]] std::string_view View() const;
+
     [[nodiscard]] const char *CharsNonNul() const;
 
     [[nodiscard]] uint64_t Length() const;
@@ -16,6 +16,8 @@ class Request
   private:
     friend class RequestBuilder;
     friend class Client;
+    friend class Ring;
+    friend class RequestTemplate;
 
   private:
     template <typename... Args> static std::unique_ptr<Request> Create(Args &&...args)
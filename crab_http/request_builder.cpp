@@ -2,7 +2,11 @@
 
 #include "crab_http_c.h"
 #include "header_map.h"
+#include "header_name.h"
+#include "header_value.h"
+#include "json_writer.h"
 #include "request.h"
+#include "request_template.h"
 #include "response.h"
 
 namespace crab::http
@@ -21,9 +25,10 @@ RequestBuilder::uptr RequestBuilder::Build(void *handle)
     return Create(handle);
 }
 
-RequestBuilder *RequestBuilder::basic_auth(const std::string &username, const std::string &password)
+RequestBuilder *RequestBuilder::basic_auth(std::string_view username, std::string_view password)
 {
-    auto builder = request_builder_basic_auth(handle_, username.c_str(), password.c_str());
+    auto builder = request_builder_basic_auth_len(handle_, reinterpret_cast<const uint8_t *>(username.data()), username.size(),
+                                                  reinterpret_cast<const uint8_t *>(password.data()), password.size());
     if (builder)
     {
         handle_ = builder;
@@ -31,9 +36,9 @@ RequestBuilder *RequestBuilder::basic_auth(const std::string &username, const st
     return this;
 }
 
-RequestBuilder *RequestBuilder::bearer_auth(const std::string &token)
+RequestBuilder *RequestBuilder::bearer_auth(std::string_view token)
 {
-    auto builder = request_builder_bearer_auth(handle_, token.c_str());
+    auto builder = request_builder_bearer_auth_len(handle_, reinterpret_cast<const uint8_t *>(token.data()), token.size());
     if (builder)
     {
         handle_ = builder;
@@ -43,7 +48,17 @@ RequestBuilder *RequestBuilder::bearer_auth(const std::string &token)
 
 RequestBuilder *RequestBuilder::body(const std::vector<uint8_t> &bytes)
 {
-    auto builder = request_builder_body_bytes(handle_, &bytes[0], bytes.size());
+    auto builder = request_builder_body_bytes(handle_, bytes.data(), bytes.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+RequestBuilder *RequestBuilder::body(const uint8_t *data, size_t len, ReleaseCallback release, void *user_data)
+{
+    auto builder = request_builder_body_external(handle_, data, len, release, user_data);
     if (builder)
     {
         handle_ = builder;
@@ -75,6 +90,29 @@ RequestBuilder *RequestBuilder::file_body(const std::string &file_path)
 }
 #endif
 
+#if defined(_WIN32) || defined(_MSC_VER)
+RequestBuilder *RequestBuilder::file_body_mapped(const std::wstring &file_path)
+{
+    auto builder = request_builder_body_file_mapped_wide(handle_, file_path.c_str(), file_path.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+#else
+RequestBuilder *RequestBuilder::file_body_mapped(const std::string &file_path)
+{
+    auto builder = request_builder_body_file_mapped(handle_, file_path.c_str());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+#endif
+
 #if defined(_WIN32) || defined(_MSC_VER)
 
 RequestBuilder *RequestBuilder::file_body_with_name(const std::string &file_name, const std::wstring &file_path)
@@ -100,9 +138,39 @@ RequestBuilder *RequestBuilder::file_body_with_name(const std::string &file_name
 }
 #endif
 
+RequestBuilder *RequestBuilder::body_stream(BodyReader reader, std::optional<uint64_t> length)
+{
+    auto user_data = new BodyReader(std::move(reader));
+    auto builder = request_builder_body_stream(handle_, &RequestBuilder::OnBodyRead, &RequestBuilder::OnBodyRelease, user_data,
+                                               length ? &*length : nullptr);
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+int64_t RequestBuilder::OnBodyRead(void *user_data, uint8_t *buf, uintptr_t buf_len)
+{
+    try
+    {
+        return (*static_cast<BodyReader *>(user_data))(buf, buf_len);
+    }
+    catch (...)
+    {
+        // unwinding into the Rust runtime is undefined behaviour, abort the upload instead
+        return -1;
+    }
+}
+
+void RequestBuilder::OnBodyRelease(void *user_data)
+{
+    delete static_cast<BodyReader *>(user_data);
+}
+
 RequestBuilder *RequestBuilder::body(const std::string &str)
 {
-    auto builder = request_builder_body_string(handle_, str.c_str());
+    auto builder = request_builder_body_bytes(handle_, reinterpret_cast<const uint8_t *>(str.data()), str.size());
     if (builder)
     {
         handle_ = builder;
@@ -112,7 +180,7 @@ RequestBuilder *RequestBuilder::body(const std::string &str)
 
 RequestBuilder *RequestBuilder::form(const std::vector<Pair> &pairs)
 {
-    auto builder = request_builder_form(handle_, &pairs[0], pairs.size());
+    auto builder = request_builder_form(handle_, pairs.data(), pairs.size());
     if (builder)
     {
         handle_ = builder;
@@ -122,13 +190,38 @@ RequestBuilder *RequestBuilder::form(const std::vector<Pair> &pairs)
 
 RequestBuilder *RequestBuilder::form(const std::initializer_list<Pair> &pairs)
 {
-    std::vector<Pair> tmp(pairs);
-    return this->form(tmp);
+    auto builder = request_builder_form(handle_, pairs.begin(), pairs.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
 }
 
-RequestBuilder *RequestBuilder::header(const std::string &key, const std::string &value)
+RequestBuilder *RequestBuilder::header(std::string_view key, std::string_view value)
 {
-    auto builder = request_builder_header(handle_, key.c_str(), value.c_str());
+    auto builder =
+        request_builder_header_len(handle_, reinterpret_cast<const uint8_t *>(key.data()), key.size(), reinterpret_cast<const uint8_t *>(value.data()), value.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+RequestBuilder *RequestBuilder::header(const HeaderName &name, const HeaderValue &value)
+{
+    auto builder = request_builder_header_interned(handle_, name.handle_, value.handle_);
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+RequestBuilder *RequestBuilder::header(const HeaderName &name, std::string_view value)
+{
+    auto builder = request_builder_header_named_len(handle_, name.handle_, reinterpret_cast<const uint8_t *>(value.data()), value.size());
     if (builder)
     {
         handle_ = builder;
@@ -147,9 +240,24 @@ RequestBuilder *RequestBuilder::headers(std::unique_ptr<HeaderMap> headers)
     return this;
 }
 
+RequestBuilder *RequestBuilder::headers(const Pair *headers, size_t len)
+{
+    auto builder = request_builder_header_pairs(handle_, headers, len);
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+RequestBuilder *RequestBuilder::headers(const std::initializer_list<Pair> &headers)
+{
+    return this->headers(headers.begin(), headers.size());
+}
+
 RequestBuilder *RequestBuilder::json(const std::vector<Pair> &pairs)
 {
-    auto builder = request_builder_json(handle_, &pairs[0], pairs.size());
+    auto builder = request_builder_json(handle_, pairs.data(), pairs.size());
     if (builder)
     {
         handle_ = builder;
@@ -159,8 +267,12 @@ RequestBuilder *RequestBuilder::json(const std::vector<Pair> &pairs)
 
 RequestBuilder *RequestBuilder::json(const std::initializer_list<Pair> &pairs)
 {
-    std::vector<Pair> tmp(pairs);
-    return this->json(tmp);
+    auto builder = request_builder_json(handle_, pairs.begin(), pairs.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
 }
 
 RequestBuilder *RequestBuilder::json(const std::string &json)
@@ -170,9 +282,42 @@ RequestBuilder *RequestBuilder::json(const std::string &json)
     return this;
 }
 
+RequestBuilder *RequestBuilder::json(std::unique_ptr<JsonWriter> writer)
+{
+    if (!writer)
+    {
+        return this;
+    }
+
+    auto builder = request_builder_json_writer(handle_, writer->handle_);
+    writer->handle_ = nullptr;
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
+}
+
+std::unique_ptr<JsonWriter> RequestBuilder::json_stream()
+{
+    if (!handle_)
+    {
+        return nullptr;
+    }
+
+    auto writer = request_builder_json_stream(handle_);
+    handle_ = nullptr;
+
+    if (!writer)
+    {
+        return nullptr;
+    }
+    return JsonWriter::Build(writer);
+}
+
 RequestBuilder *RequestBuilder::query(const std::vector<Pair> &querys)
 {
-    auto builder = request_builder_query(handle_, &querys[0], querys.size());
+    auto builder = request_builder_query(handle_, querys.data(), querys.size());
     if (builder)
     {
         handle_ = builder;
@@ -182,8 +327,12 @@ RequestBuilder *RequestBuilder::query(const std::vector<Pair> &querys)
 
 RequestBuilder *RequestBuilder::query(const std::initializer_list<Pair> &querys)
 {
-    std::vector<Pair> tmp(querys);
-    return this->query(tmp);
+    auto builder = request_builder_query(handle_, querys.begin(), querys.size());
+    if (builder)
+    {
+        handle_ = builder;
+    }
+    return this;
 }
 
 std::unique_ptr<Response> RequestBuilder::send()
@@ -202,6 +351,38 @@ std::unique_ptr<Response> RequestBuilder::send()
     return Response::Build(resp);
 }
 
+bool RequestBuilder::send_async(ResponseCallback callback)
+{
+    if (!handle_)
+    {
+        return false;
+    }
+
+    auto user_data = new ResponseCallback(std::move(callback));
+    bool queued = request_builder_send_async(handle_, &RequestBuilder::OnResponse, user_data);
+    handle_ = nullptr;
+
+    if (!queued)
+    {
+        delete user_data;
+    }
+    return queued;
+}
+
+void RequestBuilder::OnResponse(void *user_data, void *response)
+{
+    std::unique_ptr<ResponseCallback> callback(static_cast<ResponseCallback *>(user_data));
+    Response::uptr resp = response ? Response::Build(response) : nullptr;
+    try
+    {
+        (*callback)(std::move(resp));
+    }
+    catch (...)
+    {
+        // unwinding into the Rust runtime is undefined behaviour
+    }
+}
+
 RequestBuilder *RequestBuilder::timeout(uint64_t millisecond)
 {
     auto builder = request_builder_timeout(handle_, millisecond);
@@ -212,19 +393,20 @@ RequestBuilder *RequestBuilder::timeout(uint64_t millisecond)
     return this;
 }
 
-RequestBuilder *RequestBuilder::try_clone()
+RequestBuilder::uptr RequestBuilder::try_clone() const
 {
     auto builder = request_builder_try_clone(handle_);
-    if (builder)
+    if (!builder)
     {
-        handle_ = builder;
+        return nullptr;
     }
-    return this;
+    return Build(builder);
 }
 
-RequestBuilder *RequestBuilder::version(const std::string &version)
+RequestBuilder *RequestBuilder::version(std::string_view version)
 {
-    auto builder = request_builder_version(handle_, version.c_str());
+    auto builder =
+        request_builder_version_len(handle_, reinterpret_cast<const uint8_t *>(version.data()), version.size());
     if (builder)
     {
         handle_ = builder;
@@ -249,4 +431,22 @@ std::unique_ptr<Request> RequestBuilder::build()
 
     return Request::Build(req);
 }
+
+std::unique_ptr<RequestTemplate> RequestBuilder::build_template()
+{
+    if (!handle_)
+    {
+        return nullptr;
+    }
+
+    auto tpl = request_template_new(handle_);
+    handle_ = nullptr;
+
+    if (!tpl)
+    {
+        return nullptr;
+    }
+
+    return RequestTemplate::Build(tpl);
+}
 } // namespace crab::http
\ No newline at end of file
@@ -1,17 +1,25 @@
 #pragma once
 
+#include <functional>
 #include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace crab::http
 {
 class Response;
 class Request;
+class RequestTemplate;
 class HeaderMap;
+class HeaderName;
+class HeaderValue;
+class JsonWriter;
 struct Pair;
 class Client;
+class SendAwaiter;
 
 class RequestBuilder
 {
@@ -20,6 +28,14 @@ class RequestBuilder
   public:
     using uptr = std::unique_ptr<RequestBuilder>;
 
+    using ResponseCallback = std::function<void(std::unique_ptr<Response>)>;
+
+    using ReleaseCallback = void (*)(void *user_data);
+
+    /// Fills `buf` with up to `buf_len` bytes; returns the count, 0 at the end
+    /// of the body or -1 to abort the request.
+    using BodyReader = std::function<int64_t(uint8_t *buf, size_t buf_len)>;
+
   private:
     template <typename... Args> static std::unique_ptr<RequestBuilder> Create(Args &&...args)
     {
@@ -35,6 +51,12 @@ class RequestBuilder
   private:
     static uptr Build(void *handle);
 
+    static void OnResponse(void *user_data, void *response);
+
+    static int64_t OnBodyRead(void *user_data, uint8_t *buf, uintptr_t buf_len);
+
+    static void OnBodyRelease(void *user_data);
+
     explicit RequestBuilder(void *handle);
 
   public:
@@ -52,14 +74,21 @@ class RequestBuilder
 
   public:
     /// Enable HTTP basic authentication.
-    RequestBuilder *basic_auth(const std::string &username, const std::string &password);
+    RequestBuilder *basic_auth(std::string_view username, std::string_view password);
 
     /// Enable HTTP bearer authentication.
-    RequestBuilder *bearer_auth(const std::string &token);
+    RequestBuilder *bearer_auth(std::string_view token);
 
     /// Set the request body from u8 array.
     RequestBuilder *body(const std::vector<uint8_t> &bytes);
 
+    /// Set the request body from `len` bytes at `data` without copying them.
+    ///
+    /// The memory must stay valid and unchanged until `release(user_data)` is
+    /// called, exactly once, possibly on a runtime worker thread. `release` may
+    /// be null for memory that outlives the request.
+    RequestBuilder *body(const uint8_t *data, size_t len, ReleaseCallback release, void *user_data);
+
     /// Set the request body from file.
 #if defined(_WIN32) || defined(_MSC_VER)
 
@@ -69,6 +98,17 @@ class RequestBuilder
     RequestBuilder *file_body(const std::string &file_path);
 #endif
 
+    /// Set the request body from a memory-mapped file, sent straight from the
+    /// page cache without userspace copies. Pipes and other files that can't
+    /// be mapped are read like `file_body`.
+    ///
+    /// The file must not be truncated while the request is in flight.
+#if defined(_WIN32) || defined(_MSC_VER)
+    RequestBuilder *file_body_mapped(const std::wstring &file_path);
+#else
+    RequestBuilder *file_body_mapped(const std::string &file_path);
+#endif
+
 #if defined(_WIN32) || defined(_MSC_VER)
 
     RequestBuilder *file_body_with_name(const std::string &file_name, const std::wstring &file_path);
@@ -77,7 +117,15 @@ class RequestBuilder
     RequestBuilder *file_body_with_name(const std::string &file_name, const std::string &file_path);
 #endif
 
-    /// Set the request body from UTF-8 text.
+    /// Stream the request body from `reader` instead of holding it in memory.
+    ///
+    /// `reader` is pulled on a background thread as the connection accepts
+    /// data, so a slow upstream throttles it. With `length` the body is sent
+    /// with `Content-Length`, otherwise with chunked encoding. Exceptions
+    /// thrown by `reader` abort the request.
+    RequestBuilder *body_stream(BodyReader reader, std::optional<uint64_t> length = std::nullopt);
+
+    /// Set the request body from text. Embedded NUL bytes are kept.
     RequestBuilder *body(const std::string &str);
 
     /// Send a form body.
@@ -90,11 +138,26 @@ class RequestBuilder
     RequestBuilder *form(const std::initializer_list<Pair> &querys);
 
     /// Add a `Header` to this Request.
-    RequestBuilder *header(const std::string &key, const std::string &value);
+    RequestBuilder *header(std::string_view key, std::string_view value);
+
+    /// Add a `Header` from handles validated once, so nothing is parsed here.
+    RequestBuilder *header(const HeaderName &name, const HeaderValue &value);
+
+    /// Add a `Header` with an interned name and a per-request value.
+    RequestBuilder *header(const HeaderName &name, std::string_view value);
 
     /// Add a `Header` to this Request.
     RequestBuilder *headers(std::unique_ptr<HeaderMap> headers);
 
+    /// Add `len` headers in one call, validated together.
+    ///
+    /// Like the `HeaderMap` overload, a name set earlier loses its old values;
+    /// one repeated in `headers` keeps all of its own. Nothing is added if any
+    /// pair is invalid.
+    RequestBuilder *headers(const Pair *headers, size_t len);
+
+    RequestBuilder *headers(const std::initializer_list<Pair> &headers);
+
     /// Send a smaple JSON body.
     ///
     /// Sets the body to the JSON serialization of the passed value, and
@@ -106,6 +169,16 @@ class RequestBuilder
     /// It is same to use header(content-type,application/json).body(json)
     RequestBuilder *json(const std::string &json);
 
+    /// Use the complete document of `writer` as the body, moved rather than
+    /// copied, with `Content-Type: application/json`.
+    RequestBuilder *json(std::unique_ptr<JsonWriter> writer);
+
+    /// Send the request now and return a writer whose document is uploaded
+    /// with chunked encoding while it is written; only a few 64 KiB chunks
+    /// are held at a time. Consumes the builder, replacing any body; call
+    /// `JsonWriter::finish()` for the response.
+    std::unique_ptr<JsonWriter> json_stream();
+
     /// Modify the query string of the URL.
     ///
     /// Modifies the URL of this request, adding the parameters provided.
@@ -126,6 +199,22 @@ class RequestBuilder
     /// redirect loop was detected or redirect limit was exhausted.
     std::unique_ptr<Response> send();
 
+    /// Constructs the Request and sends it on the shared runtime without
+    /// blocking the calling thread.
+    ///
+    /// `callback` is invoked exactly once, on a runtime worker thread. On
+    /// failure it receives nullptr and `TakeLastError()` called inside the
+    /// callback returns the reason. The callback must not throw.
+    ///
+    /// Returns false if the request could not be queued.
+    bool send_async(ResponseCallback callback);
+
+    /// `co_await`-able variant of `send()` that suspends the calling coroutine
+    /// instead of blocking its thread; it resumes on a runtime worker thread.
+    ///
+    /// Requires C++20 and `coroutine.h`.
+    SendAwaiter send_async();
+
     /// Enables a request timeout.
     ///
     /// The timeout is applied from when the request starts connecting until the
@@ -133,14 +222,20 @@ class RequestBuilder
     /// the timeout configured using `ClientBuilder::timeout()`.
     RequestBuilder *timeout(uint64_t millisecond);
 
-    // if return null clone failed
-    RequestBuilder *try_clone();
+    /// A new builder with the same settings; this one is left as it was.
+    /// nullptr if the body is a stream, which can't be cloned.
+    uptr try_clone() const;
 
     /// Set HTTP version
-    RequestBuilder *version(const std::string &version);
+    RequestBuilder *version(std::string_view version);
 
     std::unique_ptr<Request> build();
 
+    /// Parse everything set so far once, for requests that differ only in
+    /// path, query, a few headers or the body. Consumes the builder like
+    /// `build()`; nullptr if the body is a stream.
+    std::unique_ptr<RequestTemplate> build_template();
+
   private:
     void *handle_{nullptr};
 };
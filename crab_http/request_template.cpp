@@ -0,0 +1,41 @@
+#include "request_template.h"
+
+#include "request.h"
+#include "response.h"
+
+namespace crab::http
+{
+RequestTemplate::RequestTemplate(void *handle) : handle_(handle)
+{
+}
+
+RequestTemplate::~RequestTemplate()
+{
+    request_template_destroy(handle_);
+}
+
+RequestTemplate::uptr RequestTemplate::Build(void *handle)
+{
+    return Create(handle);
+}
+
+std::unique_ptr<Request> RequestTemplate::request(const TemplateArgs &args) const
+{
+    auto req = request_template_request(handle_, &args);
+    if (!req)
+    {
+        return nullptr;
+    }
+    return Request::Build(req);
+}
+
+std::unique_ptr<Response> RequestTemplate::send(const TemplateArgs &args) const
+{
+    auto resp = request_template_send(handle_, &args);
+    if (!resp)
+    {
+        return nullptr;
+    }
+    return Response::Build(resp);
+}
+} // namespace crab::http
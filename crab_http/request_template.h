@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+class Request;
+class RequestBuilder;
+class Response;
+
+/// A request built once and instantiated many times. Method, URL, headers
+/// and body are parsed by `RequestBuilder::build_template()`; each call
+/// only clones them and applies `TemplateArgs`. May be shared by threads.
+class RequestTemplate
+{
+    friend class RequestBuilder;
+
+  public:
+    using uptr = std::unique_ptr<RequestTemplate>;
+
+  private:
+    template <typename... Args> static std::unique_ptr<RequestTemplate> Create(Args &&...args)
+    {
+        struct make_unique_helper : public RequestTemplate
+        {
+            explicit make_unique_helper(Args &&...a) : RequestTemplate(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    static uptr Build(void *handle);
+
+    explicit RequestTemplate(void *handle);
+
+  public:
+    RequestTemplate() = delete;
+
+    RequestTemplate(const RequestTemplate &) = delete;
+
+    RequestTemplate(RequestTemplate &&) = delete;
+
+    RequestTemplate &operator=(const RequestTemplate &) = delete;
+
+    RequestTemplate &operator=(RequestTemplate &&) = delete;
+
+    ~RequestTemplate();
+
+  public:
+    /// A request with `args` applied, for `Client::execute` or
+    /// `Client::execute_batch`. nullptr if `args` are invalid.
+    std::unique_ptr<Request> request(const TemplateArgs &args = {}) const;
+
+    /// Instantiate with `args` and send with the client the builder came from.
+    std::unique_ptr<Response> send(const TemplateArgs &args = {}) const;
+
+  private:
+    void *handle_{nullptr};
+};
+} // namespace crab::http
@@ -20,6 +20,11 @@ ResponseBody::uptr ResponseBody::Build(void *handle)
 }
 
 std::string ResponseBody::Chars() const
+{
+    return std::string(View());
+}
+
+std::string_view ResponseBody::View() const
 {
     if (CharsNonNul()) {
         return {CharsNonNul(), Length()};
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+
+#if __has_include(<span>)
+#include <span>
+#endif
 
 namespace crab::http
 {
 class Response;
+class BodyAwaiter;
 
 class ResponseBody
 {
@@ -16,6 +23,8 @@ class ResponseBody
   private:
     friend class Response;
 
+    friend class BodyAwaiter;
+
   private:
     template <typename... Args> static std::unique_ptr<ResponseBody> Create(Args &&...args)
     {
@@ -46,8 +55,21 @@ class ResponseBody
 
     ~ResponseBody();
 
+    /// Copy the body into a `std::string`. Prefer `View()` to parse in place.
     [[nodiscard]] std::string Chars() const;
 
+    /// The body as a view into the buffer received from the connection,
+    /// valid as long as this `ResponseBody` lives.
+    [[nodiscard]] std::string_view View() const;
+
+#if defined(__cpp_lib_span)
+    /// Byte view of the body; same lifetime rules as `View()`.
+    [[nodiscard]] std::span<const uint8_t> Span() const
+    {
+        return {Bytes(), static_cast<size_t>(Length())};
+    }
+#endif
+
     [[nodiscard]] const char *CharsNonNul() const;
 
     [[nodiscard]] const uint8_t *Bytes() const;
@@ -2,10 +2,50 @@
 
 #include "crab_http_c.h"
 #include "header_map.h"
+#include "meta.h"
 #include "r_string.h"
 
 namespace crab::http
 {
+namespace
+{
+uint8_t *AllocateFromResource(void *user_data, uintptr_t size, uintptr_t align)
+{
+    try
+    {
+        return static_cast<uint8_t *>(static_cast<std::pmr::memory_resource *>(user_data)->allocate(size, align));
+    }
+    catch (...)
+    {
+        // unwinding into the Rust runtime is undefined behaviour, report the failure instead
+        return nullptr;
+    }
+}
+
+Allocator FromResource(std::pmr::memory_resource *resource)
+{
+    return Allocator{&AllocateFromResource, resource};
+}
+
+std::string_view ToView(const char *data, size_t len)
+{
+    if (!data)
+    {
+        return {};
+    }
+    return std::string_view(data, len);
+}
+
+std::string_view ToView(const char *data)
+{
+    if (!data)
+    {
+        return {};
+    }
+    return std::string_view(data);
+}
+} // namespace
+
 Response::Response(void *handle) : handle_(handle)
 {
 }
@@ -63,6 +103,38 @@ std::unique_ptr<ResponseBody> Response::copy_to()
     return ResponseBody::Create(buf);
 }
 
+int64_t Response::stream_to(const Sink &sink, size_t chunk_hint)
+{
+    return response_stream_to(handle_, &Response::OnChunk, const_cast<Sink *>(&sink), chunk_hint);
+}
+
+bool Response::OnChunk(void *user_data, const uint8_t *data, uintptr_t len)
+{
+    try
+    {
+        return (*static_cast<Sink *>(user_data))(data, len);
+    }
+    catch (...)
+    {
+        // unwinding into the Rust runtime is undefined behaviour, stop the transfer instead
+        return false;
+    }
+}
+
+#if defined(_WIN32) || defined(_MSC_VER)
+
+bool Response::save_to_file(const std::wstring &path, const SaveOptions &options, SaveStats *stats)
+{
+    return response_save_to_file_wide(handle_, path.c_str(), path.size(), &options, stats);
+}
+
+#else
+bool Response::save_to_file(const std::string &path, const SaveOptions &options, SaveStats *stats)
+{
+    return response_save_to_file(handle_, path.c_str(), &options, stats);
+}
+#endif
+
 uint64_t Response::content_length()
 {
     auto len = response_content_length(handle_);
@@ -85,6 +157,16 @@ std::unique_ptr<HeaderMap> Response::headers()
     return HeaderMap::Build(handle);
 }
 
+std::unique_ptr<Meta> Response::meta()
+{
+    auto meta = response_meta(handle_);
+    if (!meta)
+    {
+        return nullptr;
+    }
+    return Meta::Build(meta);
+}
+
 std::unique_ptr<RString> Response::remote_addr()
 {
     void *v = response_remote_addr(handle_);
@@ -107,4 +189,51 @@ std::unique_ptr<RString> Response::version()
     void *v = response_version(handle_);
     return RString::Build(v);
 }
+
+std::string_view Response::bodyBytes(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    size_t len = 0;
+    auto data = response_bytes_into(handle_, &allocator, &len);
+    return ToView(reinterpret_cast<const char *>(data), len);
+}
+
+std::string_view Response::bodyText(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    size_t len = 0;
+    auto data = response_text_into(handle_, &allocator, &len);
+    return ToView(data, len);
+}
+
+const Pair *Response::headers(std::pmr::memory_resource *resource, size_t &count)
+{
+    auto allocator = FromResource(resource);
+    count = 0;
+    return response_headers_into(handle_, &allocator, &count);
+}
+
+const ResponseMeta *Response::meta(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    return response_meta_into(handle_, &allocator);
+}
+
+std::string_view Response::remote_addr(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    return ToView(response_remote_addr_into(handle_, &allocator));
+}
+
+std::string_view Response::url(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    return ToView(response_url_into(handle_, &allocator));
+}
+
+std::string_view Response::version(std::pmr::memory_resource *resource)
+{
+    auto allocator = FromResource(resource);
+    return ToView(response_version_into(handle_, &allocator));
+}
 } // namespace crab::http
\ No newline at end of file
@@ -1,16 +1,24 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 
+#include "crab_http_c.h"
 #include "resp_body.h"
 
 namespace crab::http
 {
 class RString;
 class HeaderMap;
+class Meta;
 class RequestBuilder;
 class Client;
+class SendAwaiter;
+class BodyAwaiter;
+class ReadAwaiter;
 
 class Response
 {
@@ -20,9 +28,21 @@ class Response
 
     friend class Client;
 
+    friend class SendAwaiter;
+
+    friend class Ring;
+
+    friend class RequestTemplate;
+
+    friend class JsonWriter;
+
   public:
     using uptr = std::unique_ptr<Response>;
 
+    /// Receives one body chunk, valid only during the call. Return false to
+    /// stop the transfer.
+    using Sink = std::function<bool(const uint8_t *data, size_t len)>;
+
   private:
     template <typename... Args> static std::unique_ptr<Response> Create(Args &&...args)
     {
@@ -38,6 +58,8 @@ class Response
   private:
     static uptr Build(void *handle);
 
+    static bool OnChunk(void *user_data, const uint8_t *data, uintptr_t len);
+
     explicit Response(void *handle);
 
   public:
@@ -80,6 +102,10 @@ class Response
     /// The difference from copy_to is : This fun Consumption ownership
     std::unique_ptr<ResponseBody> bodyBytes();
 
+    /// `co_await`-able variant of `bodyBytes()`; resumes on a runtime worker
+    /// thread. Requires C++20 and `coroutine.h`.
+    BodyAwaiter bodyBytesAsync();
+
     /// Copy the response body into a writer.
     /// Don't forget free
     ///
@@ -93,14 +119,48 @@ class Response
     /// [`std::io::copy`]: https://doc.rust-lang.org/std/io/fn.copy.html
     std::unique_ptr<ResponseBody> copy_to();
 
+    /// Hand the body to `sink` chunk by chunk as it arrives from the socket,
+    /// without accumulating it. This fun Consumption ownership
+    ///
+    /// Chunks smaller than `chunk_hint` bytes are merged up to that size; 0
+    /// delivers them as received. Returns the number of bytes delivered, or
+    /// -1 if the transfer failed or `sink` returned false or threw.
+    int64_t stream_to(const Sink &sink, size_t chunk_hint = 0);
+
+    /// Write the body straight to the file at `path` from the Rust side,
+    /// replacing the file. This fun Consumption ownership
+    ///
+    /// Value-initialised `options` write in 1 MiB chunks without
+    /// preallocation, `O_DIRECT` or fsync. Fills `stats` when given. Returns
+    /// false on failure, which may leave a partial file behind.
+#if defined(_WIN32) || defined(_MSC_VER)
+    bool save_to_file(const std::wstring &path, const SaveOptions &options = {}, SaveStats *stats = nullptr);
+#else
+    bool save_to_file(const std::string &path, const SaveOptions &options = {}, SaveStats *stats = nullptr);
+#endif
+
     /// Get the content-length of the response, if it is known.
     uint64_t content_length();
 
+    /// Read at most `buf_len` bytes of the body into `buf`.
+    ///
+    /// Returns the number of bytes read, 0 once the body is exhausted and -1
+    /// on failure.
     int32_t read(uint8_t *buf, uint32_t buf_len);
 
+    /// `co_await`-able variant of `read()`; resumes on a runtime worker
+    /// thread. `buf` must stay valid until then. Requires C++20 and
+    /// `coroutine.h`.
+    ReadAwaiter read_async(uint8_t *buf, uint32_t buf_len);
+
     /// Get the `Headers` of this `Response`.
     std::unique_ptr<HeaderMap> headers();
 
+    /// Status, version, URL, remote address and headers in one call and one
+    /// block, instead of a call and a string per field. Must be called
+    /// before the body is consumed; nullptr on failure.
+    std::unique_ptr<Meta> meta();
+
     /// Get the remote address used to get this `Response`.
     std::unique_ptr<RString> remote_addr();
 
@@ -120,6 +180,31 @@ class Response
     ///_ => "unreachable"
     std::unique_ptr<RString> version();
 
+    // The results below are written into memory from `resource`, such as a
+    // per-request `std::pmr::monotonic_buffer_resource`, and stay valid until
+    // the resource releases it. Nothing is freed one by one. On failure they
+    // return an empty view whose `data()` is null, see `TakeLastError()`.
+
+    /// Like `bodyBytes()`, NUL-terminated. This fun Consumption ownership
+    std::string_view bodyBytes(std::pmr::memory_resource *resource);
+
+    /// Like `bodyText()`, NUL-terminated. This fun Consumption ownership
+    std::string_view bodyText(std::pmr::memory_resource *resource);
+
+    /// Every header as a NUL-terminated name and value, all in one block.
+    /// Sets `count`; returns nullptr on failure.
+    const Pair *headers(std::pmr::memory_resource *resource, size_t &count);
+
+    /// Like `meta()`, the whole block coming from `resource`; nullptr on
+    /// failure.
+    const ResponseMeta *meta(std::pmr::memory_resource *resource);
+
+    std::string_view remote_addr(std::pmr::memory_resource *resource);
+
+    std::string_view url(std::pmr::memory_resource *resource);
+
+    std::string_view version(std::pmr::memory_resource *resource);
+
   private:
     void *handle_{nullptr};
 };
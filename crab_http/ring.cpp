@@ -0,0 +1,72 @@
+#include "ring.h"
+
+#include "request.h"
+#include "response.h"
+
+namespace crab::http
+{
+Ring::Ring(void *handle, uint32_t entries) : handle_(handle), entries_(entries)
+{
+    pending_.reserve(entries_);
+}
+
+Ring::~Ring()
+{
+    for (auto &sqe : pending_)
+    {
+        request_destroy(sqe.request);
+    }
+    ring_destroy(handle_);
+}
+
+Ring::uptr Ring::Build(void *handle, uint32_t entries)
+{
+    return Create(handle, entries);
+}
+
+bool Ring::push(std::unique_ptr<Request> &request, uint64_t user_data)
+{
+    if (!request || !request->Handle() || pending_.size() >= entries_)
+    {
+        return false;
+    }
+
+    pending_.push_back(RingSqe{request->Handle(), user_data});
+    request->ResetHandle();
+    request.reset();
+    return true;
+}
+
+size_t Ring::submit()
+{
+    if (!pending_.empty())
+    {
+        auto accepted = ring_push(handle_, pending_.data(), pending_.size());
+        pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(accepted));
+    }
+    return ring_submit(handle_);
+}
+
+size_t Ring::reap(std::vector<Completion> &completions, size_t max)
+{
+    cqes_.resize(max);
+    auto count = ring_reap(handle_, cqes_.data(), max);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Completion completion;
+        completion.user_data = cqes_[i].user_data;
+        completion.error_kind = cqes_[i].error_kind;
+        if (cqes_[i].response)
+        {
+            completion.response = Response::Build(cqes_[i].response);
+        }
+        completions.push_back(std::move(completion));
+    }
+    return count;
+}
+
+int Ring::eventfd() const
+{
+    return ring_eventfd(handle_);
+}
+} // namespace crab::http
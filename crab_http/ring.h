@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+class Client;
+class Request;
+class Response;
+
+/// Submission/completion queue pair modelled on io_uring.
+///
+/// Requests are queued with `push()` without crossing into Rust, started in
+/// bulk by `submit()` and collected in bulk by `reap()`. Each completion
+/// carries its own error kind, so no `TakeLastError()` lookup is needed. On
+/// Linux `eventfd()` becomes readable whenever completions are waiting.
+///
+/// A ring is meant to be driven from one thread.
+class Ring
+{
+    friend class Client;
+
+  public:
+    using uptr = std::unique_ptr<Ring>;
+
+    struct Completion
+    {
+        uint64_t user_data{0};
+        /// nullptr if the request failed.
+        std::unique_ptr<Response> response;
+        HttpErrorKind error_kind{HttpErrorKind::NoError};
+    };
+
+  private:
+    template <typename... Args> static std::unique_ptr<Ring> Create(Args &&...args)
+    {
+        struct make_unique_helper : public Ring
+        {
+            explicit make_unique_helper(Args &&...a) : Ring(std::forward<Args>(a)...)
+            {
+            }
+        };
+        return std::make_unique<make_unique_helper>(std::forward<Args>(args)...);
+    }
+
+  private:
+    static uptr Build(void *handle, uint32_t entries);
+
+    Ring(void *handle, uint32_t entries);
+
+  public:
+    Ring() = delete;
+
+    Ring(const Ring &) = delete;
+
+    Ring(Ring &&) = delete;
+
+    Ring &operator=(const Ring &) = delete;
+
+    Ring &operator=(Ring &&) = delete;
+
+    ~Ring();
+
+  public:
+    /// Queue `request` for the next `submit()`, taking ownership of it.
+    ///
+    /// Returns false, leaving `request` untouched, if the submission queue is
+    /// full.
+    bool push(std::unique_ptr<Request> &request, uint64_t user_data);
+
+    /// Start every queued request with a single call into the runtime.
+    ///
+    /// Requests whose results would not fit the completion queue stay queued
+    /// until a later `submit()`. Returns the number started.
+    size_t submit();
+
+    /// Append up to `max` finished requests to `completions` without
+    /// blocking. Returns the number appended.
+    size_t reap(std::vector<Completion> &completions, size_t max = 64);
+
+    /// File descriptor that polls readable while completions are waiting, or
+    /// -1 if the platform has no eventfd.
+    [[nodiscard]] int eventfd() const;
+
+  private:
+    void *handle_{nullptr};
+    uint32_t entries_{0};
+    std::vector<RingSqe> pending_;
+    std::vector<RingCqe> cqes_;
+};
+} // namespace crab::http
@@ -0,0 +1,16 @@
+#include "runtime.h"
+
+#include "crab_http_c.h"
+
+namespace crab::http
+{
+bool InitRuntime(uint32_t worker_threads, bool pin_cores)
+{
+    return runtime_init(worker_threads, pin_cores);
+}
+
+uint32_t RuntimeWorkerThreads()
+{
+    return runtime_worker_threads();
+}
+} // namespace crab::http
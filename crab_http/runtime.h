@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace crab::http
+{
+/// Configure the runtime shared by every `Client` in the process.
+///
+/// `worker_threads` of 0 means one per core. With `pin_cores` each worker
+/// thread is pinned to its own CPU, round robin (Linux only); threads the
+/// runtime adds later for blocking work are not.
+///
+/// Must be called before the first client is built or request is sent;
+/// returns false if the runtime is already running, see `TakeLastError()`.
+bool InitRuntime(uint32_t worker_threads, bool pin_cores = false);
+
+/// Number of worker threads of the shared runtime, starting it if needed.
+uint32_t RuntimeWorkerThreads();
+} // namespace crab::http